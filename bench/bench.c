@@ -0,0 +1,411 @@
+/*
+ * Copyright (c) 2022, Kalopa Robotics Limited.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of Kalopa Robotics nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL KALOPA ROBOTICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Microbenchmarks for the NMEA parser.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "libgpstime.h"
+
+#define NSENTENCES		20000
+#define NROUNDS			5
+#define ROUND_TIME		100000000LL
+#define MAXLONG			400
+
+#ifndef VERSION
+#define VERSION			"unknown"
+#endif
+
+/*
+ * The corpus is one long block of NMEA data, as it would be read from
+ * the GPS, and a list of the sentences within it.
+ */
+struct	sentence	{
+	const char	*line;
+	int	len;
+} sentences[NSENTENCES];
+
+char	*corpus;
+int	corpus_len;
+int	counters[2] = {-1, -1};
+uint32_t	seed = 1;
+volatile int	sink;
+struct gps_parser	parser;
+
+void	make_corpus();
+int	add_sentence(char *, const char *, int);
+int	random_digits(char *, int);
+uint32_t	lcg();
+void	open_counters();
+void	run(char *, void (*)());
+void	bench_feed();
+void	bench_line();
+void	bench_tokenize();
+void	bench_getvalue();
+void	bench_gethms();
+void	bench_scan();
+
+/*
+ * Build the corpus, and run each of the benchmarks over it.
+ */
+int
+main(int argc, char *argv[])
+{
+	char name[32];
+	static char *kernels[] = {"avx2", "sse2", "neon", "scalar", NULL};
+	int i;
+
+	make_corpus();
+	open_counters();
+	gps_init(&parser);
+	printf("gps_time benchmark: version %s, %d sentences, %d bytes.\n",
+				VERSION, NSENTENCES, corpus_len);
+	printf("%-16s %10s %12s %14s %16s\n", "test", "ns/byte",
+			"ns/sentence", "br-miss/sent", "cache-miss/sent");
+	run("gps_feed", bench_feed);
+	run("gps_line", bench_line);
+	run("gps_tokenize", bench_tokenize);
+	run("gps_getvalue", bench_getvalue);
+	run("gps_gethms", bench_gethms);
+	for (i = 0; kernels[i] != NULL; i++) {
+		if (gps_scan_select(kernels[i]) == NULL)
+			continue;
+		snprintf(name, sizeof(name), "scan/%s", kernels[i]);
+		run(name, bench_scan);
+	}
+	exit(0);
+}
+
+/*
+ * Build a repeatable mix of sentences. Most are valid, but some have
+ * a bad checksum or none at all, some have a time that's out of range,
+ * and some are very long.
+ */
+void
+make_corpus()
+{
+	int i, n, nrmc = 0, spoil;
+	char *cp, *start, body[MAXLONG + 64];
+
+	if ((corpus = malloc(NSENTENCES * (MAXLONG + 70))) == NULL) {
+		perror("bench: malloc");
+		exit(1);
+	}
+	for (i = 0, cp = corpus; i < NSENTENCES; i++) {
+		spoil = 0;
+		switch (i % 8) {
+		case 0:
+		case 1:
+		case 5:
+			/*
+			 * Every tenth RMC has an impossible hour, and
+			 * another one in ten has a bad checksum.
+			 */
+			nrmc++;
+			spoil = (nrmc % 10 == 5);
+			n = sprintf(body, "GPRMC,%02d%02d%02d",
+					nrmc % 10 == 1 ? 25 : (i / 3600) % 24,
+					(i / 60) % 60, i % 60);
+			n += sprintf(body + n, ".000,A,5309.7743,N,01204.5576,W,0.17,78.41,200813,,,A");
+			break;
+
+		case 2:
+			n = sprintf(body, "GPGGA,%02d%02d%02d", (i / 3600) % 24,
+						(i / 60) % 60, i % 60);
+			n += sprintf(body + n, ".000,5309.7743,N,01204.5576,W,1,08,1.0,10.0,M,50.0,M,,");
+			break;
+
+		case 3:
+			n = sprintf(body, "GPGSV,3,1,12,01,40,083,46,02,17,308,41,12,07,344,39,14,22,228,45");
+			break;
+
+		case 4:
+			n = sprintf(body, "GPGSA,A,3,04,05,,09,12,,,24,,,,,2.5,1.3,2.1");
+			break;
+
+		case 6:
+			n = sprintf(body, "GPVTG,78.41,T,,M,0.17,N,0.31,K,A");
+			break;
+
+		default:
+			n = sprintf(body, "PXXX,");
+			n += random_digits(body + n, MAXLONG - n);
+			break;
+		}
+		start = cp;
+		cp += add_sentence(cp, body, n);
+		if (spoil)
+			cp[-3] ^= 1;
+		/*
+		 * And chop the checksum off the occasional VTG.
+		 */
+		if (i % 48 == 6) {
+			memcpy(cp - 5, "\r\n", 2);
+			cp -= 3;
+		}
+		sentences[i].line = start + 1;
+		sentences[i].len = cp - start - 3;
+	}
+	corpus_len = cp - corpus;
+}
+
+/*
+ * Add a sentence (with its checksum) to the corpus.
+ */
+int
+add_sentence(char *cp, const char *body, int len)
+{
+	int i, csum = 0;
+
+	for (i = 0; i < len; i++)
+		csum ^= body[i];
+	return(sprintf(cp, "$%.*s*%02X\r\n", len, body, csum));
+}
+
+/*
+ * Some random digits.
+ */
+int
+random_digits(char *cp, int n)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		cp[i] = '0' + lcg() % 10;
+	return(n);
+}
+
+/*
+ * Our own random number generator, so the corpus is the same everywhere.
+ */
+uint32_t
+lcg()
+{
+	seed = seed * 1103515245 + 12345;
+	return(seed >> 16);
+}
+
+/*
+ * Open the branch-miss and cache-miss counters, if we can.
+ */
+void
+open_counters()
+{
+#ifdef __linux__
+	int i;
+	struct perf_event_attr pe;
+	static int events[2] = {
+		PERF_COUNT_HW_BRANCH_MISSES,
+		PERF_COUNT_HW_CACHE_MISSES
+	};
+
+	for (i = 0; i < 2; i++) {
+		memset(&pe, 0, sizeof(pe));
+		pe.type = PERF_TYPE_HARDWARE;
+		pe.size = sizeof(pe);
+		pe.config = events[i];
+		pe.disabled = 1;
+		pe.exclude_kernel = 1;
+		pe.exclude_hv = 1;
+		counters[i] = syscall(SYS_perf_event_open, &pe, 0, -1, -1, 0);
+	}
+#endif
+}
+
+/*
+ * Run a benchmark. Each pass goes through the whole corpus once, and
+ * a round is as many passes as we can do in a tenth of a second. The
+ * result is from the fastest of several rounds.
+ */
+void
+run(char *name, void (*func)())
+{
+	int i, j, passes;
+	int64_t ns, best = 0;
+	long long count[2], bestcount[2] = {-1, -1};
+	struct timespec start, end;
+
+	for (i = 0; i < NROUNDS; i++) {
+		for (j = 0; j < 2; j++) {
+			if (counters[j] >= 0) {
+				ioctl(counters[j], PERF_EVENT_IOC_RESET, 0);
+				ioctl(counters[j], PERF_EVENT_IOC_ENABLE, 0);
+			}
+		}
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		passes = 0;
+		do {
+			func();
+			passes++;
+			clock_gettime(CLOCK_MONOTONIC, &end);
+			ns = (end.tv_sec - start.tv_sec) * 1000000000LL +
+						end.tv_nsec - start.tv_nsec;
+		} while (ns < ROUND_TIME);
+		ns /= passes;
+		for (j = 0; j < 2; j++) {
+			count[j] = -1;
+			if (counters[j] >= 0) {
+				ioctl(counters[j], PERF_EVENT_IOC_DISABLE, 0);
+				if (read(counters[j], &count[j], sizeof(count[j])) != sizeof(count[j]))
+					count[j] = -1;
+				else
+					count[j] /= passes;
+			}
+		}
+		if (i == 0 || ns < best) {
+			best = ns;
+			bestcount[0] = count[0];
+			bestcount[1] = count[1];
+		}
+	}
+	printf("%-16s %10.2f %12.1f", name, (double )best / corpus_len,
+					(double )best / NSENTENCES);
+	for (j = 0; j < 2; j++) {
+		if (bestcount[j] < 0)
+			printf(" %*s", j == 0 ? 14 : 16, "-");
+		else
+			printf(" %*.3f", j == 0 ? 14 : 16,
+					(double )bestcount[j] / NSENTENCES);
+	}
+	printf("\n");
+}
+
+/*
+ * Frame and parse the whole corpus, as it would be read from the GPS.
+ */
+void
+bench_feed()
+{
+	gps_feed(&parser, corpus, corpus_len, NULL);
+}
+
+/*
+ * Parse each sentence, already framed.
+ */
+void
+bench_line()
+{
+	int i;
+
+	for (i = 0; i < NSENTENCES; i++)
+		gps_line(&parser, sentences[i].line, sentences[i].len);
+}
+
+/*
+ * Split each sentence into fields.
+ */
+void
+bench_tokenize()
+{
+	int i, n = 0;
+	struct gps_scan sc;
+	struct gps_field fields[GPS_MAXFIELDS];
+
+	for (i = 0; i < NSENTENCES; i++) {
+		gps_scan(sentences[i].line, sentences[i].len, &sc);
+		n += gps_tokenize(&sc, fields, GPS_MAXFIELDS);
+	}
+	sink = n;
+}
+
+/*
+ * Decode the time and date from each RMC sentence.
+ */
+void
+bench_getvalue()
+{
+	int i, n = 0;
+	const char *cp;
+
+	for (i = 0; i < NSENTENCES; i++) {
+		cp = sentences[i].line;
+		if (cp[2] != 'R')
+			continue;
+		n += gps_getvalue(cp + 6, 2) + gps_getvalue(cp + 8, 2);
+		n += gps_getvalue(cp + 10, 2) + gps_getvalue(cp + 13, 3);
+		n += gps_getvalue(cp + 55, 2) + gps_getvalue(cp + 57, 2);
+		n += gps_getvalue(cp + 59, 2);
+	}
+	sink = n;
+}
+
+/*
+ * The same again, using the six-digits-at-a-time decoders (which also
+ * range-check the fields, so the odd impossible hour gets rejected).
+ */
+void
+bench_gethms()
+{
+	int i, n = 0, secs, year, mon, mday;
+	long nsec;
+	const char *cp;
+	struct gps_field time = {6, 10}, date = {55, 6};
+
+	for (i = 0; i < NSENTENCES; i++) {
+		cp = sentences[i].line;
+		if (cp[2] != 'R')
+			continue;
+		if (gps_gethms(cp, sentences[i].len, &time, &secs, &nsec) == 0)
+			n += secs + nsec;
+		if (gps_getdmy(cp, sentences[i].len, &date, &year, &mon, &mday) == 0)
+			n += year + mon + mday;
+	}
+	sink = n;
+}
+
+/*
+ * Find the delimiters and checksum of each sentence, using whichever
+ * scanner is currently selected.
+ */
+void
+bench_scan()
+{
+	int i, n = 0;
+	struct gps_scan sc;
+
+	for (i = 0; i < NSENTENCES; i++) {
+		gps_scan(sentences[i].line, sentences[i].len, &sc);
+		n += sc.csum;
+	}
+	sink = n;
+}
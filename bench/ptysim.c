@@ -0,0 +1,340 @@
+/*
+ * Copyright (c) 2022, Kalopa Robotics Limited.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of Kalopa Robotics nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL KALOPA ROBOTICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Simulate a GPS on a pseudo-terminal, and measure gps_time's latency.
+ */
+#define _XOPEN_SOURCE		700
+
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#define NSEC			1000000000LL
+#define TICK			1000000LL
+#define MAXSENTENCES		100000
+#define START_TIME		1704067200
+
+/*
+ * For each sentence sent, the GPS time in it and when we finished
+ * writing it. Once gps_time reports the fix, the latency.
+ */
+struct	sent	{
+	int64_t	utc;
+	int64_t	written;
+	int64_t	latency;
+} sent[MAXSENTENCES];
+
+int	baud = 9600;
+int	rate = 1;
+int	count = 20;
+int	master;
+int	nsent;
+int	nfixes;
+int	outfd;
+char	outbuf[4096];
+int	outlen;
+
+pid_t	start_gps_time(char *, char *, char *[]);
+void	send_sentence(int64_t);
+void	wait_until(int64_t);
+void	read_fixes(int);
+void	results();
+int64_t	now();
+int	cmp64(const void *, const void *);
+void	usage();
+
+/*
+ * Start gps_time on one end of a pseudo-terminal, and feed it NMEA
+ * data on the other.
+ */
+int
+main(int argc, char *argv[])
+{
+	int i;
+	char *slave, *prog = "./gps_time";
+	pid_t pid;
+	int64_t next, period;
+
+	while ((i = getopt(argc, argv, "s:r:n:g:")) != EOF) {
+		switch (i) {
+		case 's':
+			baud = atoi(optarg);
+			break;
+
+		case 'r':
+			rate = atoi(optarg);
+			break;
+
+		case 'n':
+			count = atoi(optarg);
+			break;
+
+		case 'g':
+			prog = optarg;
+			break;
+
+		default:
+			usage();
+			break;
+		}
+	}
+	if (baud <= 0 || rate <= 0 || count <= 0 || count > MAXSENTENCES)
+		usage();
+	if ((master = posix_openpt(O_RDWR|O_NOCTTY)) < 0 ||
+				grantpt(master) < 0 || unlockpt(master) < 0 ||
+				(slave = ptsname(master)) == NULL) {
+		perror("ptysim: pty");
+		exit(1);
+	}
+	pid = start_gps_time(prog, slave, argv + optind);
+	/*
+	 * Give gps_time a chance to set up the tty, then send a
+	 * sentence at the start of each period.
+	 */
+	period = NSEC / rate;
+	next = now() + NSEC / 2;
+	read_fixes(500);
+	tcflush(master, TCIOFLUSH);
+	send_sentence(START_TIME * NSEC - period);
+	for (nsent = 0; nsent < count; nsent++) {
+		next += period;
+		wait_until(next);
+		send_sentence(START_TIME * NSEC + nsent * period);
+	}
+	read_fixes(1000);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	results();
+	exit(0);
+}
+
+/*
+ * Start gps_time reading from the pseudo-terminal, as a daemon which
+ * doesn't touch the clock but just reports each fix.
+ */
+pid_t
+start_gps_time(char *prog, char *slave, char *extra[])
+{
+	int i, pfd[2];
+	char bstr[16], *args[64];
+	pid_t pid;
+
+	snprintf(bstr, sizeof(bstr), "%d", baud);
+	args[0] = prog;
+	args[1] = "-d";
+	args[2] = "-n";
+	args[3] = "-s";
+	args[4] = bstr;
+	args[5] = "-l";
+	args[6] = slave;
+	for (i = 7; i < 63 && *extra != NULL; i++)
+		args[i] = *extra++;
+	args[i] = NULL;
+	if (pipe(pfd) < 0 || (pid = fork()) < 0) {
+		perror("ptysim: fork");
+		exit(1);
+	}
+	if (pid == 0) {
+		dup2(pfd[1], 1);
+		close(pfd[0]);
+		close(pfd[1]);
+		close(master);
+		setenv("TZ", "UTC", 1);
+		execv(prog, args);
+		perror(prog);
+		_exit(1);
+	}
+	close(pfd[1]);
+	outfd = pfd[0];
+	return(pid);
+}
+
+/*
+ * Send an RMC sentence for the given time, at the speed it would come
+ * down the wire from the GPS. Note when the end of it was written.
+ */
+void
+send_sentence(int64_t utc)
+{
+	int i, n, len, csum = 0, chunk;
+	char body[128], line[160];
+	time_t secs = utc / NSEC;
+	struct tm *tmp = gmtime(&secs);
+	struct sent *sp;
+	int64_t next;
+
+	len = snprintf(body, sizeof(body),
+		"GPRMC,%02d%02d%02d.%03d,A,5309.7743,N,01204.5576,W,0.17,78.41,%02d%02d%02d,,,A",
+		tmp->tm_hour, tmp->tm_min, tmp->tm_sec, (int )(utc % NSEC / 1000000),
+		tmp->tm_mday, tmp->tm_mon + 1, tmp->tm_year % 100);
+	for (i = 0; i < len; i++)
+		csum ^= body[i];
+	len = snprintf(line, sizeof(line), "$%s*%02X\r\n", body, csum);
+	/*
+	 * Write as many characters as would be sent in each tick. The
+	 * sentence is complete (as far as gps_time is concerned) as soon
+	 * as the CR is written, and gps_time may well have the fix before
+	 * write() returns, so note the time just before writing it.
+	 */
+	if ((chunk = baud * TICK / (10 * NSEC)) < 1)
+		chunk = 1;
+	if ((sp = &sent[nsent]) >= &sent[MAXSENTENCES] || utc < START_TIME * NSEC)
+		sp = NULL;
+	if (sp != NULL) {
+		sp->utc = utc;
+		sp->written = sp->latency = -1;
+	}
+	next = now();
+	for (i = 0; i < len; i += n) {
+		n = (len - i < chunk) ? len - i : chunk;
+		next += n * 10 * NSEC / baud;
+		wait_until(next);
+		if (sp != NULL && i + n > len - 2 && sp->written < 0)
+			sp->written = now();
+		if (write(master, line + i, n) != n) {
+			perror("ptysim: write");
+			exit(1);
+		}
+	}
+}
+
+/*
+ * Wait until the given (monotonic) time, reading any fixes reported
+ * by gps_time in the meantime.
+ */
+void
+wait_until(int64_t when)
+{
+	int64_t left;
+
+	while ((left = when - now()) > 0)
+		read_fixes(left > TICK ? left / TICK : 1);
+}
+
+/*
+ * Wait (for up to a given number of milliseconds) for fixes from
+ * gps_time, and match them up with the sentences we sent.
+ */
+void
+read_fixes(int msecs)
+{
+	int i, n;
+	char *cp, *ep;
+	long long sec, nsec, msec, mnsec;
+	struct pollfd pfd;
+
+	pfd.fd = outfd;
+	pfd.events = POLLIN;
+	if (poll(&pfd, 1, msecs) <= 0)
+		return;
+	if ((n = read(outfd, outbuf + outlen, sizeof(outbuf) - outlen - 1)) <= 0)
+		return;
+	outlen += n;
+	outbuf[outlen] = '\0';
+	for (cp = outbuf; (ep = strchr(cp, '\n')) != NULL; cp = ep + 1) {
+		*ep = '\0';
+		if (sscanf(cp, "fix %lld.%lld %*c offset %*f mono %lld.%lld",
+					&sec, &nsec, &msec, &mnsec) != 4)
+			continue;
+		for (i = nsent; i >= 0 && i > nsent - 8; i--) {
+			if (i < MAXSENTENCES && sent[i].utc == sec * NSEC + nsec &&
+					sent[i].written >= 0 && sent[i].latency < 0) {
+				sent[i].latency = msec * NSEC + mnsec - sent[i].written;
+				nfixes++;
+				break;
+			}
+		}
+	}
+	outlen -= cp - outbuf;
+	memmove(outbuf, cp, outlen);
+}
+
+/*
+ * Report on the latency from the end of each sentence to gps_time
+ * having the fix.
+ */
+void
+results()
+{
+	int i, n;
+	int64_t lat[MAXSENTENCES], sum = 0;
+
+	for (i = n = 0; i < count; i++)
+		if (sent[i].latency >= 0)
+			sum += (lat[n++] = sent[i].latency);
+	printf("%d sentences at %d baud, %d Hz: %d fixes.\n", count, baud, rate, n);
+	if (n == 0)
+		return;
+	qsort(lat, n, sizeof(lat[0]), cmp64);
+	printf("Latency (us): min %.1f, median %.1f, mean %.1f, 99%% %.1f, max %.1f\n",
+			lat[0] / 1e3, lat[n / 2] / 1e3, sum / 1e3 / n,
+			lat[n * 99 / 100] / 1e3, lat[n - 1] / 1e3);
+}
+
+/*
+ * The monotonic time, in nanoseconds.
+ */
+int64_t
+now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return(ts.tv_sec * NSEC + ts.tv_nsec);
+}
+
+int
+cmp64(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+	return(x < y ? -1 : x > y);
+}
+
+/*
+ * Usage message & exit.
+ */
+void
+usage()
+{
+	fprintf(stderr, "Usage: ptysim [-s 9600][-r 1][-n 20][-g ./gps_time] [-- gps_time args]\n");
+	exit(2);
+}
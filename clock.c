@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2022, Kalopa Robotics Limited.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of Kalopa Robotics nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL KALOPA ROBOTICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Apply a GPS-derived time to the system clock.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "gps_time.h"
+
+#define STEP_THRESHOLD		(NSEC / 2)
+
+int	slewing;
+int	started;
+int64_t	applied;
+int64_t	pending;
+
+void	discipline(int64_t);
+int	sane(struct gps_fix *);
+int	step(int64_t);
+void	one_shot(int64_t);
+void	show_fix(struct gps_fix *);
+
+/*
+ * We have a valid time from the GPS. In the normal (one-shot) case,
+ * set the system time and we're done. In daemon mode, hand it off to
+ * the discipline code and keep going. For a dry run, just say what
+ * we would have done. If we're feeding an NTP daemon, give it the fix
+ * and let it look after the clock.
+ *
+ * The GPS time is the time at which the GPS started to send the
+ * sentence, so the offset of the system clock is measured from the
+ * realtime stamp for then, rather than when we got around to
+ * processing it. Either way, it's the filtered offset over the last
+ * few fixes which gets applied, rather than that of any one of them,
+ * and a one-shot set waits until there are enough of them.
+ *
+ * Only a fix with a good status and a believable date gets anywhere
+ * near the clock. In daemon mode, the first one steps the clock (if
+ * it's far enough out) and from then on it's only ever slewed.
+ */
+void
+set_clock(struct gps_fix *fp)
+{
+	int n, stepped;
+	int64_t offset;
+	struct timespec mono;
+
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	if (verbose)
+		printf("Sentence took %.3f ms to arrive, %.3f ms to process.\n",
+			(ts_ns(&fp->end.mono) - ts_ns(&fp->start.mono)) / 1e6,
+			(ts_ns(&mono) - ts_ns(&fp->end.mono)) / 1e6);
+	if (dry_run) {
+		show_fix(fp);
+		if (!daemon_mode)
+			exit(0);
+		return;
+	}
+	if (refclock) {
+		/*
+		 * The NTP daemon has the first fix, so there's no need to
+		 * hold up whoever started us any longer.
+		 */
+		refclock_publish(fp);
+		if (fp->valid && !started) {
+			started = 1;
+			detach();
+		}
+		return;
+	}
+	if (!sane(fp))
+		return;
+	offset = ts_ns(&fp->utc) - ts_ns(&fp->epoch.real);
+	if (daemon_mode) {
+		if (!started) {
+			started = 1;
+			stepped = (offset <= -STEP_THRESHOLD || offset >= STEP_THRESHOLD) &&
+							step(offset) == 0;
+			detach();
+			if (stepped)
+				return;
+		}
+		discipline(offset);
+		return;
+	}
+	n = filter_add(offset);
+	if (!filter_full()) {
+		if (verbose)
+			printf("Have %d fixes, waiting for more...\n", n);
+		return;
+	}
+	one_shot(filter_offset());
+}
+
+/*
+ * The first fix didn't arrive in time (or there weren't enough of
+ * them to fill the filter). If we're setting the clock once, make do
+ * with what we have, or give up. A daemon just carries on in the
+ * background.
+ */
+void
+clock_deadline(int secs)
+{
+	if (daemon_mode) {
+		if (!started && verbose)
+			printf("No time fix within %d seconds, carrying on.\n", secs);
+		detach();
+		return;
+	}
+	if (!dry_run && filter_count() > 0)
+		one_shot(filter_offset());
+	fprintf(stderr, "gps_time: no time fix within %d seconds.\n", secs);
+	exit(1);
+}
+
+/*
+ * Is this fix fit to set the clock with? The receiver has to say it's
+ * good, and the date can't be before this program was built (which
+ * catches a receiver that has lost track of the GPS week).
+ */
+int
+sane(struct gps_fix *fp)
+{
+	static time_t floor;
+
+	if (floor == 0)
+		floor = gps_utctime(atoi(__DATE__ + 7), 1, 1, 0, 0, 0);
+	if (!fp->valid) {
+		if (verbose)
+			printf("Receiver status is not valid - not using this fix.\n");
+		return(0);
+	}
+	if (fp->utc.tv_sec < floor) {
+		if (verbose)
+			printf("GPS date is before %.4s - not using this fix.\n", __DATE__ + 7);
+		return(0);
+	}
+	return(1);
+}
+
+/*
+ * Step the system clock by an offset.
+ */
+int
+step(int64_t offset)
+{
+	struct timespec real;
+	struct timeval tval;
+
+	clock_gettime(CLOCK_REALTIME, &real);
+	ns_to_tv(ts_ns(&real) + offset, &tval);
+	if (verbose)
+		printf("Setting time to %s", ctime(&tval.tv_sec));
+	if (settimeofday(&tval, NULL) < 0) {
+		perror("gps_time: settimeofday");
+		return(-1);
+	}
+	return(0);
+}
+
+/*
+ * Set the clock once, and we're done.
+ */
+void
+one_shot(int64_t offset)
+{
+	time_t now;
+
+	if (step(offset) < 0)
+		return;
+	time(&now);
+	printf("%s", ctime(&now));
+	if (verbose)
+		printf("Time set successfully. Operation complete.\n");
+	exit(0);
+}
+
+/*
+ * Discipline the system clock towards the GPS time. Rather than
+ * stepping the clock (and upsetting anything which cares about time
+ * going backwards), filter the offset between the GPS and the system
+ * clock, and hand it to the discipline loop.
+ *
+ * The offsets in the filter were measured at different times, with
+ * more or less of our own corrections applied to the clock. So they
+ * are all kept relative to the clock as it would be without them: add
+ * on however much has been corrected so far (what we last asked for,
+ * less what's still to go), and take it back off the filtered offset.
+ */
+void
+discipline(int64_t offset)
+{
+	int64_t filtered;
+
+	if (slewing)
+		applied += pending - loop_remaining();
+	filter_add(offset + applied);
+	filtered = filter_offset() - applied;
+	if (verbose)
+		printf("Clock offset: %+.6f seconds, filtered %+.6f.\n",
+					offset / 1e9, filtered / 1e9);
+	loop_update(filtered);
+	pending = filtered;
+	slewing = 1;
+}
+
+/*
+ * Report a fix, rather than doing anything with it. Along with the
+ * GPS time, show the offset from the system clock when the sentence
+ * was sent, and the (monotonic) time at which we had the fix.
+ */
+void
+show_fix(struct gps_fix *fp)
+{
+	struct timespec mono;
+
+	clock_gettime(CLOCK_MONOTONIC, &mono);
+	printf("fix %lld.%09ld %c offset %+.9f mono %lld.%09ld\n",
+			(long long )fp->utc.tv_sec, fp->utc.tv_nsec,
+			fp->valid ? 'A' : 'V',
+			(ts_ns(&fp->utc) - ts_ns(&fp->epoch.real)) / 1e9,
+			(long long )mono.tv_sec, mono.tv_nsec);
+}
+
+/*
+ * Convert a (possibly negative) number of nanoseconds to a timeval.
+ */
+void
+ns_to_tv(int64_t ns, struct timeval *tvp)
+{
+	tvp->tv_sec = ns / NSEC;
+	if ((ns %= NSEC) < 0) {
+		tvp->tv_sec--;
+		ns += NSEC;
+	}
+	tvp->tv_usec = ns / 1000;
+}
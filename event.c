@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2022, Kalopa Robotics Limited.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of Kalopa Robotics nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL KALOPA ROBOTICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Wait for I/O on any number of file descriptors.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <errno.h>
+#ifdef __linux__
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
+#include "gps_time.h"
+
+#define MAXEVENTS		16
+
+#ifdef __linux__
+static	int	epfd = -1;
+#else
+static	int	nevents = 0;
+static	struct event	*events[MAXEVENTS];
+#endif
+
+/*
+ * Start watching a file descriptor. When there's something to read,
+ * the event function is called.
+ */
+void
+event_add(struct event *evp)
+{
+#ifdef __linux__
+	struct epoll_event ee;
+
+	if (epfd < 0 && (epfd = epoll_create1(EPOLL_CLOEXEC)) < 0) {
+		perror("gps_time: epoll_create1");
+		exit(1);
+	}
+	ee.events = EPOLLIN;
+	ee.data.ptr = evp;
+	if (epoll_ctl(epfd, EPOLL_CTL_ADD, evp->fd, &ee) < 0) {
+		perror("gps_time: epoll_ctl");
+		exit(1);
+	}
+#else
+	if (nevents >= MAXEVENTS) {
+		fprintf(stderr, "gps_time: too many file descriptors.\n");
+		exit(1);
+	}
+	events[nevents++] = evp;
+#endif
+}
+
+/*
+ * Stop watching a file descriptor.
+ */
+void
+event_del(struct event *evp)
+{
+#ifdef __linux__
+	epoll_ctl(epfd, EPOLL_CTL_DEL, evp->fd, NULL);
+#else
+	int i;
+
+	for (i = 0; i < nevents; i++) {
+		if (events[i] == evp) {
+			events[i] = events[--nevents];
+			break;
+		}
+	}
+#endif
+}
+
+/*
+ * Wait (for up to the specified number of milliseconds, or forever if
+ * it's negative) for something to happen, and dispatch whatever does.
+ * Returns the number of events dispatched.
+ */
+int
+event_wait(int msecs)
+{
+	int i, n;
+#ifdef __linux__
+	struct epoll_event ee[MAXEVENTS];
+
+	if ((n = epoll_wait(epfd, ee, MAXEVENTS, msecs)) < 0) {
+		if (errno == EINTR)
+			return(0);
+		perror("gps_time: epoll_wait");
+		exit(1);
+	}
+	for (i = 0; i < n; i++) {
+		struct event *evp = ee[i].data.ptr;
+
+		evp->func(evp);
+	}
+#else
+	int npfd, nready;
+	struct pollfd pfd[MAXEVENTS];
+	struct event *ready[MAXEVENTS];
+
+	for (i = npfd = 0; i < nevents; i++, npfd++) {
+		pfd[i].fd = events[i]->fd;
+		pfd[i].events = POLLIN;
+		pfd[i].revents = 0;
+		ready[i] = events[i];
+	}
+	if ((nready = poll(pfd, npfd, msecs)) < 0) {
+		if (errno == EINTR)
+			return(0);
+		perror("gps_time: poll");
+		exit(1);
+	}
+	/*
+	 * The event list might change as we dispatch, so work from
+	 * the copy we took before polling.
+	 */
+	for (i = n = 0; i < npfd && n < nready; i++) {
+		if (pfd[i].revents != 0) {
+			ready[i]->func(ready[i]);
+			n++;
+		}
+	}
+#endif
+	return(n);
+}
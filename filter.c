@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2022, Kalopa Robotics Limited.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of Kalopa Robotics nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL KALOPA ROBOTICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Filter the clock offsets from a run of fixes. The last few offsets
+ * are kept in a ring, in the order they arrived, and also in a sorted
+ * array, so that one sentence which turned up late can't drag the
+ * estimate with it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gps_time.h"
+
+#define MAXWINDOW		64
+
+struct	filter	{
+	int	size;
+	int	count;
+	int	next;
+	int64_t	ring[MAXWINDOW];
+	int64_t	sorted[MAXWINDOW];
+} filt;
+
+int	filter_search(int64_t);
+
+/*
+ * Set the number of offsets to filter over.
+ */
+void
+filter_init(int size)
+{
+	if (size < 1 || size > MAXWINDOW) {
+		fprintf(stderr, "gps_time: filter window must be 1 to %d fixes.\n",
+							MAXWINDOW);
+		exit(2);
+	}
+	filt.size = size;
+	filt.count = filt.next = 0;
+}
+
+/*
+ * Add an offset to the filter, pushing out the oldest one if the window
+ * is full. The position of each is found with a binary search of the
+ * sorted offsets. Returns the number of offsets in the window.
+ */
+int
+filter_add(int64_t offset)
+{
+	int i;
+
+	if (filt.count == filt.size) {
+		i = filter_search(filt.ring[filt.next]);
+		memmove(&filt.sorted[i], &filt.sorted[i + 1],
+				(filt.count - i - 1) * sizeof(int64_t));
+		filt.count--;
+	}
+	i = filter_search(offset);
+	memmove(&filt.sorted[i + 1], &filt.sorted[i],
+				(filt.count - i) * sizeof(int64_t));
+	filt.sorted[i] = offset;
+	filt.count++;
+	filt.ring[filt.next] = offset;
+	filt.next = (filt.next + 1) % filt.size;
+	return(filt.count);
+}
+
+/*
+ * How many offsets are in the window?
+ */
+int
+filter_count()
+{
+	return(filt.count);
+}
+
+/*
+ * Is the window full yet?
+ */
+int
+filter_full()
+{
+	return(filt.count == filt.size);
+}
+
+/*
+ * The filtered offset. This is the mean of the middle half of the
+ * sorted offsets, so the outliers at either end are ignored, but the
+ * rest are averaged. For up to four offsets, that's just the median.
+ * (The sum is kept relative to the smallest, as the offsets can be
+ * decades' worth of nanoseconds.)
+ */
+int64_t
+filter_offset()
+{
+	int i, lo, hi;
+	int64_t sum = 0;
+
+	if (filt.count == 0)
+		return(0);
+	lo = (filt.count + 1) / 4;
+	hi = filt.count - lo;
+	for (i = lo; i < hi; i++)
+		sum += filt.sorted[i] - filt.sorted[lo];
+	return(filt.sorted[lo] + sum / (hi - lo));
+}
+
+/*
+ * Find where an offset is (or would go) in the sorted array.
+ */
+int
+filter_search(int64_t offset)
+{
+	int lo = 0, hi = filt.count, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (filt.sorted[mid] < offset)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return(lo);
+}
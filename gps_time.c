@@ -43,13 +43,40 @@
 #include <termios.h>
 #include <time.h>
 #include <string.h>
+#include <errno.h>
 #include <ctype.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/serial.h>
+#endif
+
+#include "gps_time.h"
 
 #define BUFFER_SIZE		512
+#define MAXDEVICES		8
+#define MAXAGE			2
+#define REPORT_INTERVAL		10
+#define CHECK_INTERVAL		1000
 
-#define ST_WAITNL		0
-#define ST_WAITDL		1
-#define ST_CAPTURE		2
+/*
+ * Each GPS device has its own parser, and we keep track of the last
+ * fix it gave us.
+ */
+struct	device	{
+	char	*name;
+	int	fd;
+	int	baud;
+	struct event	event;
+	struct gps_parser	parser;
+	struct gps_fix	last;
+	struct timespec	when;
+	struct timespec	resume;
+	unsigned long	nsyscalls;
+	unsigned long	nfixes;
+	int64_t	latsum;
+	int64_t	latmax;
+	time_t	reported;
+};
 
 /*
  * Translate table to convert a baud rate into a B-number for the kernel.
@@ -80,13 +107,31 @@ struct	speed	{
 };
 
 int	verbose;
+int	daemon_mode;
+int	dry_run;
+int	refchar;
+int	measure;
+char	*pps_source;
+int	lowlat;
+int	batch;
+int	configure;
+int	newbaud;
+int	ndevices;
+int	nopen;
+struct	device	devices[MAXDEVICES];
 char	rdata[BUFFER_SIZE];
-char	input[BUFFER_SIZE];
 
-void	process(int);
-void	gps_line();
-int	crack(char *, char *[], int);
-int	getvalue(char *, int);
+void	open_device(struct device *);
+int	speed_code(int);
+void	device_read(struct event *);
+void	device_pause(struct device *, struct timespec *);
+int	device_timeout(int);
+void	device_resume();
+void	fix(struct gps_parser *, struct gps_fix *);
+int	select_source(struct device *);
+void	wakeup_policy(char *);
+void	report(struct device *, struct timespec *);
+char	*abspath(char *);
 void	usage();
 
 /*
@@ -95,38 +140,277 @@ void	usage();
 int
 main(int argc, char *argv[])
 {
-	int i, fd, baud = 9600;
-	char *cp, *device = "/dev/ttyu0";
-	struct termios tios;
+	int i, baud = 0, shm_unit = -1, window = 5, deadline = 0;
+	int64_t left;
+	struct timespec now, expires;
+	char *replay_file = NULL, *sock_path = NULL, *page_path = NULL;
+	char *state_file = NULL;
+	struct device *dp;
 
 	/*
-	 * Do the command-line arguments.
+	 * Do the command-line arguments. A baud rate applies to the
+	 * devices which follow it. Any device without one gets the
+	 * last baud rate specified (or 9600 if there wasn't one).
 	 */
-	verbose = 0;
-	while ((i = getopt(argc, argv, "s:l:v")) != EOF) {
+	verbose = daemon_mode = dry_run = refchar = measure = 0;
+	pps_source = NULL;
+	ndevices = 0;
+	while ((i = getopt(argc, argv, "s:l:vdC:w:mnr:P:S:K:M:F:H:t:I:B:")) != EOF) {
 		switch (i) {
 		case 's':
 			baud = atoi(optarg);
 			break;
 
 		case 'l':
-			device = optarg;
+			if (ndevices == MAXDEVICES) {
+				fprintf(stderr, "gps_time: too many devices.\n");
+				exit(1);
+			}
+			devices[ndevices].name = optarg;
+			devices[ndevices++].baud = baud;
 			break;
 
 		case 'v':
 			verbose = 1;
 			break;
 
+		case 'd':
+			daemon_mode = 1;
+			break;
+
+		case 'C':
+			if ((refchar = atoi(optarg)) < 0)
+				usage();
+			break;
+
+		case 'w':
+			wakeup_policy(optarg);
+			break;
+
+		case 'm':
+			measure = 1;
+			break;
+
+		case 'n':
+			dry_run = 1;
+			break;
+
+		case 'r':
+			replay_file = optarg;
+			break;
+
+		case 'P':
+			pps_source = optarg;
+			break;
+
+		case 'S':
+			shm_unit = atoi(optarg);
+			break;
+
+		case 'K':
+			sock_path = abspath(optarg);
+			break;
+
+		case 'M':
+			page_path = optarg;
+			break;
+
+		case 'F':
+			window = atoi(optarg);
+			break;
+
+		case 'H':
+			state_file = abspath(optarg);
+			break;
+
+		case 't':
+			deadline = atoi(optarg);
+			break;
+
+		case 'I':
+			if (receiver_select(optarg) < 0) {
+				fprintf(stderr, "gps_time: unknown receiver: %s\n", optarg);
+				exit(2);
+			}
+			configure = 1;
+			break;
+
+		case 'B':
+			newbaud = atoi(optarg);
+			break;
+
 		default:
 			usage();
 			break;
 		}
 	}
+	/*
+	 * Replaying a file is a whole different thing. The baud rate
+	 * (if there is one) is the speed at which to replay it.
+	 */
+	if (replay_file != NULL)
+		replay(replay_file, baud);
+	if (newbaud != 0 && (!configure || speed_code(newbaud) < 0))
+		usage();
+	if (baud == 0)
+		baud = 9600;
+	filter_init(window);
+	/*
+	 * When feeding an NTP daemon, we keep going indefinitely.
+	 */
+	if (shm_unit >= 0)
+		shm_open_unit(shm_unit);
+	if (sock_path != NULL)
+		sock_open(sock_path);
+	if (refclock)
+		daemon_mode = 1;
+	if (page_path != NULL)
+		page_open(page_path);
+	if (state_file != NULL && daemon_mode && !refclock && !dry_run)
+		loop_state(state_file);
+	if (ndevices == 0)
+		devices[ndevices++].name = "/dev/ttyu0";
+	for (i = 0; i < ndevices; i++) {
+		if (devices[i].baud == 0)
+			devices[i].baud = baud;
+		open_device(&devices[i]);
+	}
+	if (pps_source != NULL)
+		pps_open(pps_source);
+	/*
+	 * Anyone watching for fixes wants to see them as soon as they
+	 * happen. With a deadline, a daemon stays in the foreground until
+	 * it has applied its first good fix (or the deadline passes), so
+	 * that whoever started it knows the time is right when it returns.
+	 */
+	if (dry_run)
+		setvbuf(stdout, NULL, _IOLBF, 0);
+	if (deadline == 0)
+		detach();
+	/*
+	 * Set up a parser for each device, and wait for data to
+	 * arrive on any of them.
+	 */
+	if (verbose)
+		printf("Using %s NMEA scanner.\n", gps_scan_select(NULL));
+	for (i = 0; i < ndevices; i++) {
+		dp = &devices[i];
+		gps_init(&dp->parser);
+		dp->parser.verbose = verbose;
+		dp->parser.baud = dp->baud;
+		dp->parser.refchar = refchar;
+		dp->parser.arg = dp;
+		dp->parser.fix = fix;
+		dp->event.fd = dp->fd;
+		dp->event.func = device_read;
+		dp->event.arg = dp;
+		event_add(&dp->event);
+	}
+	/*
+	 * When disciplining the clock, wake up every so often (even if
+	 * the GPS has gone quiet) to see if it's time for holdover.
+	 */
+	clock_gettime(CLOCK_MONOTONIC, &expires);
+	expires.tv_sec += deadline;
+	for (nopen = ndevices; nopen > 0;) {
+		left = -1;
+		if (deadline > 0) {
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			if ((left = (ts_ns(&expires) - ts_ns(&now)) / 1000000) <= 0) {
+				clock_deadline(deadline);
+				deadline = 0;
+				continue;
+			}
+		}
+		left = device_timeout(left);
+		if (daemon_mode && !refclock && !dry_run) {
+			if (left < 0 || left > CHECK_INTERVAL)
+				left = CHECK_INTERVAL;
+			event_wait(left);
+			device_resume();
+			loop_check();
+		} else {
+			event_wait(left);
+			device_resume();
+		}
+	}
+	if (verbose)
+		printf("Program terminated normally.\n");
+	exit(0);
+}
+
+/*
+ * Find the B-number for a baud rate, or -1 if there isn't one.
+ */
+int
+speed_code(int baud)
+{
+	int i;
+
+	for (i = 0; speeds[i].value > 0; i++)
+		if (speeds[i].value == baud)
+			return(speeds[i].code);
+	return(-1);
+}
+
+/*
+ * In daemon mode, drop into the background (unless we've been asked
+ * to be verbose, to measure things or to report fixes, in which case
+ * stay where we can be seen). Only the first call does anything.
+ */
+void
+detach()
+{
+	static int detached = 0;
+
+	if (detached || !daemon_mode || verbose || measure || dry_run)
+		return;
+	detached = 1;
+	if (daemon(0, 0) < 0) {
+		perror("gps_time: daemon");
+		exit(1);
+	}
+}
+
+/*
+ * Make a path absolute. The state file and chrony socket are opened
+ * again after daemon() has moved us to the root directory, so a
+ * relative path has to be taken from where we started. The file may
+ * not exist yet, so this can't be left to realpath().
+ */
+char *
+abspath(char *path)
+{
+	char *p, cwd[1024];
+
+	if (*path == '/')
+		return(path);
+	if (getcwd(cwd, sizeof(cwd)) == NULL) {
+		perror("gps_time: getcwd");
+		exit(1);
+	}
+	if ((p = malloc(strlen(cwd) + strlen(path) + 2)) == NULL) {
+		perror("gps_time: malloc");
+		exit(1);
+	}
+	sprintf(p, "%s/%s", cwd, path);
+	return(p);
+}
+
+/*
+ * Open a GPS device and set the tty parameters.
+ */
+void
+open_device(struct device *dp)
+{
+	int code;
+	struct termios tios;
+
 	if (verbose)
-		printf("GPS device: %s, speed: %d.\n", device, baud);
-	if ((fd = open(device, O_RDONLY|O_NOCTTY)) < 0) {
+		printf("GPS device: %s, speed: %d.\n", dp->name, dp->baud);
+	if ((dp->fd = open(dp->name, (configure ? O_RDWR : O_RDONLY)|O_NOCTTY|O_NONBLOCK)) < 0) {
 		fprintf(stderr, "gps_time: ");
-		perror(device);
+		perror(dp->name);
 		exit(1);
 	}
 	/*
@@ -134,15 +418,12 @@ main(int argc, char *argv[])
 	 */
 	if (verbose)
 		printf("Setting serial I/O parameters.\n");
-	if (tcgetattr(fd, &tios) < 0) {
+	if (tcgetattr(dp->fd, &tios) < 0) {
 		perror("gps_time: tcgetattr");
 		exit(1);
 	}
-	for (i = 0; speeds[i].value > 0; i++)
-		if (speeds[i].value == baud)
-			break;
-	if (speeds[i].value == 0) {
-		fprintf(stderr, "gps_time: invalid baud rate: %d\n", baud);
+	if ((code = speed_code(dp->baud)) < 0) {
+		fprintf(stderr, "gps_time: invalid baud rate: %d\n", dp->baud);
 		exit(1);
 	}
 	tios.c_iflag &= ~(IGNBRK | BRKINT | ICRNL | INLCR | PARMRK | INPCK | ISTRIP | IXON);
@@ -152,206 +433,294 @@ main(int argc, char *argv[])
 	tios.c_cflag |= CS8;
 	tios.c_cc[VMIN] = 1;
 	tios.c_cc[VTIME] = 0;
-	cfsetispeed(&tios, speeds[i].code);
-	cfsetospeed(&tios, speeds[i].code);
-	if (tcsetattr(fd, TCSANOW, &tios) < 0) {
+	cfsetispeed(&tios, code);
+	cfsetospeed(&tios, code);
+	if (tcsetattr(dp->fd, TCSANOW, &tios) < 0) {
 		perror("gps_time: tcsetattr");
 		exit(1);
 	}
 	/*
-	 * Convert the fd into a FILE pointer - let someone else
-	 * do the buffering...
+	 * Tell the receiver what we want from it. If that includes a new
+	 * baud rate, wait for the commands to go, and then follow it. The
+	 * receiver might take a moment to switch, and anything which
+	 * arrived in the meantime is junk.
 	 */
-	if (verbose)
-		printf("Opening file descriptor as a file.\n");
+	if (configure) {
+		receiver_config(dp->fd, newbaud);
+		if (newbaud != 0) {
+			if (tcdrain(dp->fd) < 0)
+				perror("gps_time: tcdrain");
+			usleep(100000);
+			code = speed_code(newbaud);
+			cfsetispeed(&tios, code);
+			cfsetospeed(&tios, code);
+			if (tcsetattr(dp->fd, TCSAFLUSH, &tios) < 0) {
+				perror("gps_time: tcsetattr");
+				exit(1);
+			}
+			dp->baud = newbaud;
+			if (verbose)
+				printf("GPS device: %s, new speed: %d.\n", dp->name, dp->baud);
+		}
+	}
+#ifdef __linux__
 	/*
-	 * Read each character from the serial device, and process it.
+	 * Ask the serial driver not to sit on received data.
 	 */
-	while ((i = read(fd, cp = rdata, BUFFER_SIZE)) > 0) {
-		while (i-- > 0)
-			process(*cp++);
+	if (lowlat) {
+		struct serial_struct ss;
+
+		if (ioctl(dp->fd, TIOCGSERIAL, &ss) < 0)
+			perror("gps_time: TIOCGSERIAL");
+		else {
+			ss.flags |= ASYNC_LOW_LATENCY;
+			if (ioctl(dp->fd, TIOCSSERIAL, &ss) < 0)
+				perror("gps_time: TIOCSSERIAL");
+		}
 	}
-	if (verbose)
-		printf("Program terminated normally.\n");
-	exit(0);
+#endif
 }
 
 /*
- * Process a single character of serial data.
+ * Decide how often the kernel should wake us up with serial data.
+ * The choices are for every byte (the default) for the most accurate
+ * timestamps, or for every byte with the serial driver's low latency
+ * mode turned on, or in batches, which takes far fewer system calls.
+ * A batch is whatever has arrived in the given number of milliseconds
+ * (default 20) since the last read.
+ *
+ * VMIN and VTIME can't do the batching for us. The descriptor is
+ * non-blocking and watched by the event loop, and the tty says it's
+ * readable on the first byte if VTIME is set, or only once there are
+ * VMIN bytes if it isn't, which strands the end of a burst.
  */
 void
-process(int ch)
+wakeup_policy(char *policy)
 {
-	static int inpos = 0;
-	static int state = ST_WAITNL;
+	char *cp;
 
-	if (ch == '\n' || ch == '\r') {
-		/*
-		 * Saw a CR/NL. Process a line, if we have one.
-		 */
-		if (state == ST_CAPTURE) {
-			input[inpos++] = '\0';
-			gps_line();
-		}
-		state = ST_WAITDL;
+	if ((cp = strchr(policy, ',')) != NULL)
+		*cp++ = '\0';
+	if (strcmp(policy, "byte") == 0) {
+		batch = 0;
 		return;
 	}
-	/*
-	 * If we're waiting for a dollar-sign, then if we get one
-	 * then we're good. Otherwise, any other character will
-	 * force us into waiting for a new CR/LF.
-	 */
-	if (state == ST_WAITDL) {
-		inpos = 0;
-		if (ch == '$')
-			state = ST_CAPTURE;
-		else
-			state = ST_WAITNL;
+	if (strcmp(policy, "lowlat") == 0) {
+#ifndef __linux__
+		fprintf(stderr, "gps_time: low latency mode is not supported.\n");
+		exit(1);
+#endif
+		batch = 0;
+		lowlat = 1;
 		return;
 	}
+	if (strcmp(policy, "batch") != 0)
+		usage();
+	batch = (cp != NULL) ? atoi(cp) : 20;
+	if (batch < 1 || batch > 1000) {
+		fprintf(stderr, "gps_time: invalid batch interval: %s\n", cp);
+		exit(1);
+	}
+}
+
+/*
+ * There's data waiting on a GPS device. Read it, and feed it to the
+ * device's parser. The event loop is level-triggered, so anything
+ * left over wakes us up again straight away, and there's no need to
+ * keep reading until the device is empty.
+ */
+void
+device_read(struct event *evp)
+{
+	int n;
+	struct gps_stamp stamp;
+	struct device *dp = evp->arg;
+
 	/*
-	 * Capture the character, if we're in the right state.
+	 * Note when the data arrived, so we can allow for the time it
+	 * took to get to us. Count the wait which woke us up, as well as
+	 * the read.
 	 */
-	if (state != ST_CAPTURE)
+	n = read(dp->fd, rdata, BUFFER_SIZE);
+	clock_gettime(CLOCK_REALTIME, &stamp.real);
+	clock_gettime(CLOCK_MONOTONIC, &stamp.mono);
+	dp->nsyscalls += 2;
+	if (n > 0) {
+		gps_feed(&dp->parser, rdata, n, &stamp);
+		if (batch)
+			device_pause(dp, &stamp.mono);
 		return;
-	if (inpos >= sizeof(input) - 2) {
+	}
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
 		/*
-		 * Line is too long. Dump it.
+		 * The burst is over, so go back to waiting for the
+		 * first byte of the next one.
 		 */
-		state = ST_WAITNL;
+		if (dp->resume.tv_sec != 0) {
+			dp->resume.tv_sec = dp->resume.tv_nsec = 0;
+			event_add(evp);
+			dp->nsyscalls++;
+		}
 		return;
 	}
-	input[inpos++] = ch;
+	if (n < 0)
+		perror(dp->name);
+	else if (verbose)
+		printf("%s: end of file.\n", dp->name);
+	if (dp->resume.tv_sec == 0)
+		event_del(evp);
+	dp->resume.tv_sec = dp->resume.tv_nsec = 0;
+	close(dp->fd);
+	nopen--;
 }
 
 /*
- * Handle a single line of GPS data. Really we only care about GPRMC lines.
+ * Batch up the rest of a burst. Stop watching the device, and come back
+ * for whatever has arrived after the batch interval. Everything in a
+ * batch is stamped when it's read, so a fix can be late by up to the
+ * interval.
  */
 void
-gps_line()
+device_pause(struct device *dp, struct timespec *now)
 {
-	int csum = 0;
-	char *cp, *args[20];
-	struct timeval tval;
-	struct tm tm;
-	time_t now;
-
-	if (verbose)
-		printf("GPS: [%s]\n", input);
-	if (strncmp(input, "GPRMC", 5) != 0) {
-		if (verbose)
-			printf("Waiting for an RMC message - ignoring this one...\n");
-		return;
+	if (dp->resume.tv_sec == 0) {
+		event_del(&dp->event);
+		dp->nsyscalls++;
 	}
-	/*
-	 * Skip to the end of the sentence, just before the checksum.
-	 */
-	for (cp = input; *cp; cp++) {
-		if (*cp == '*')
-			break;
-		csum ^= *cp;
+	dp->resume.tv_sec = now->tv_sec + batch / 1000;
+	dp->resume.tv_nsec = now->tv_nsec + (batch % 1000) * 1000000L;
+	if (dp->resume.tv_nsec >= NSEC) {
+		dp->resume.tv_sec++;
+		dp->resume.tv_nsec -= NSEC;
 	}
-	/*
-	 * No checksum? Dunno what that was - ditch it.
-	 */
-	if (*cp != '*') {
-		if (verbose)
-			printf("?Badly formed NMEA sentence - ignoring...\n");
-		return;
-	}
-	/*
-	 * Compare the checksum we computed versus the one at the
-	 * end of the sentence.
-	 */
-	if (strtol(cp + 1, NULL, 16) != csum) {
-		if (verbose)
-			printf("?Invalid checksum - ignoring...\n");
-		return;
+}
+
+/*
+ * How long the event loop can wait (in milliseconds, or forever if it's
+ * negative) before it's time to read the next batch from a device.
+ */
+int
+device_timeout(int msecs)
+{
+	int i, left;
+	struct timespec now;
+
+	if (!batch)
+		return(msecs);
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (i = 0; i < ndevices; i++) {
+		if (devices[i].resume.tv_sec == 0)
+			continue;
+		left = (ts_ns(&devices[i].resume) - ts_ns(&now) + 999999) / 1000000;
+		if (left < 0)
+			left = 0;
+		if (msecs < 0 || left < msecs)
+			msecs = left;
 	}
-	*cp = '\0';
-	if (verbose)
-		printf("Checksum is good.\n");
-	/*
-	 * Split the sentence into its arguments (comma-based).
-	 */
-	if (crack(input, args, 20) != 13) {
-		if (verbose)
-			printf("Incorrect number of RMC paramaters in sentence...\n");
+	return(msecs);
+}
+
+/*
+ * Read the next batch from any device which is due.
+ */
+void
+device_resume()
+{
+	int i;
+	struct timespec now;
+
+	if (!batch)
 		return;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	for (i = 0; i < ndevices; i++) {
+		if (devices[i].resume.tv_sec != 0 &&
+				ts_ns(&devices[i].resume) <= ts_ns(&now))
+			device_read(&devices[i].event);
 	}
-	if (verbose) {
-		/*
-		 * Show the encoded time and date fields.
-		 */
-		printf("GPS Time: %s\n", args[1]);
-		printf("GPS Date: %s\n", args[9]);
-	}
-	/*
-	 * Fill a TM struct based on the data in the sentence. Note
-	 * that the year is a bit Y2K, but what can ya do.
-	 */
-	tm.tm_sec = getvalue(args[1] + 4, 2);
-	tm.tm_min = getvalue(args[1] + 2, 2);
-	tm.tm_hour = getvalue(args[1], 2);
-	tm.tm_mday = getvalue(args[9], 2);
-	tm.tm_mon = getvalue(args[9] + 2, 2) - 1;
-	tm.tm_year = getvalue(args[9] + 4, 2) + 100;
-	tm.tm_isdst = 0;
-	tm.tm_gmtoff = 0L;
-	tval.tv_sec = mktime(&tm);
-	tval.tv_usec = getvalue(args[1] + 7, 3) * 1000;
-	if (verbose)
-		printf("Setting time to %s", ctime(&tval.tv_sec));
-	/*
-	 * Set the system time.
-	 */
-	if (settimeofday(&tval, NULL) == 0) {
-		time(&now);
-		printf("%s", ctime(&now));
-		if (verbose)
-			printf("Time set successfully. Operation complete.\n");
-		exit(0);
-	}
-	perror("gps_time: settimeofday");
 }
 
 /*
- * Crack a comman-separated string into components.
+ * We have a time fix from one of the GPS devices. Use it, if it
+ * came from the best source we have.
  */
-int
-crack(char *strp, char *argv[], int maxargs)
+void
+fix(struct gps_parser *gp, struct gps_fix *fp)
 {
-	int n;
-	char *cp;
+	struct device *dp = gp->arg;
 
-	if (strp == NULL || *strp == '\0')
-		return(0);
-	for (n = 0; n < maxargs; n++) {
-		while (isspace(*strp))
-				strp++;
-		if (*strp == '\0')
-			return(n);
-		argv[n] = strp;
-		if ((cp = strchr(strp, ',')) != NULL)
-				*cp++ = '\0';
-		strp = cp;
-		if (strp == NULL || *strp == '\0')
-				break;
+	dp->last = *fp;
+	clock_gettime(CLOCK_MONOTONIC, &dp->when);
+	if (measure)
+		report(dp, &dp->when);
+	if (pps_source != NULL)
+		pps_label(fp);
+	if (select_source(dp)) {
+		page_publish(fp);
+		set_clock(fp);
 	}
-	return(n + 1);
 }
 
 /*
- * Get a numeric value from a string.
+ * Keep track of how much work it takes to get each sentence, and how
+ * long it takes from being woken up with the end of a sentence to
+ * having a fix, and report on it every so often. The work is counted
+ * in system calls: each wait for data and each read (including those
+ * which find nothing). A wait which wakes up several devices at once
+ * is counted against each of them.
+ */
+void
+report(struct device *dp, struct timespec *now)
+{
+	int64_t latency;
+	unsigned long nsent;
+
+	latency = ts_ns(now) - ts_ns(&dp->last.end.mono);
+	dp->latsum += latency;
+	if (latency > dp->latmax)
+		dp->latmax = latency;
+	dp->nfixes++;
+	if (dp->reported == 0)
+		dp->reported = now->tv_sec;
+	if (now->tv_sec - dp->reported < REPORT_INTERVAL)
+		return;
+	nsent = dp->parser.nsentences;
+	printf("%s: %lu syscalls, %lu sentences (%.2f syscalls/sentence), ",
+			dp->name, dp->nsyscalls, nsent,
+			nsent > 0 ? (double )dp->nsyscalls / nsent : 0.0);
+	printf("wakeup to fix %.1f us mean, %.1f us max.\n",
+			dp->latsum / 1e3 / dp->nfixes, dp->latmax / 1e3);
+	fflush(stdout);
+	dp->nsyscalls = dp->nfixes = dp->parser.nsentences = 0;
+	dp->latsum = dp->latmax = 0;
+	dp->reported = now->tv_sec;
+}
+
+/*
+ * Pick the best of the GPS devices. The devices are in order of
+ * preference, and we use the first one with a recent, valid fix.
+ * If none of them has a valid fix, take whatever we can get.
+ * Returns true if the specified device is the chosen one.
  */
 int
-getvalue(char *strp, int ndigits)
+select_source(struct device *dp)
 {
-	int value = 0;
+	int i;
+	struct device *sp;
+	static struct device *selected = NULL;
 
-	while (ndigits-- && isdigit(*strp))
-		value = value * 10 + *strp++ - '0';
-	return(value);
+	for (i = 0; i < ndevices; i++) {
+		sp = &devices[i];
+		if (sp->last.valid && sp->when.tv_sec != 0 &&
+				dp->when.tv_sec - sp->when.tv_sec <= MAXAGE)
+			break;
+	}
+	sp = (i < ndevices) ? sp : dp;
+	if (sp != selected) {
+		if (verbose)
+			printf("Selected GPS source: %s\n", sp->name);
+		selected = sp;
+	}
+	return(sp == dp);
 }
 
 /*
@@ -360,6 +729,6 @@ getvalue(char *strp, int ndigits)
 void
 usage()
 {
-	fprintf(stderr, "Usage: gps_time [-s 9600][-l /dev/ttyu0][-v]\n");
+	fprintf(stderr, "Usage: gps_time [-s 9600][-l /dev/ttyu0 ...][-r file][-P pps][-S unit][-K socket][-M page][-F 5][-H statefile][-t secs][-I mtk|ubx[,hz]][-B baud][-v][-d][-n][-m][-C 0][-w byte|lowlat|batch[,ms]]\n");
 	exit(2);
 }
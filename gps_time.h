@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2022, Kalopa Robotics Limited.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of Kalopa Robotics nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL KALOPA ROBOTICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Common definitions for the gps_time application.
+ */
+#ifndef _GPS_TIME_H_
+#define _GPS_TIME_H_
+
+#include <stdint.h>
+#include <sys/time.h>
+
+#include "libgpstime.h"
+
+#define NSEC			1000000000LL
+
+/*
+ * Something to wait for, in the event loop.
+ */
+struct	event	{
+	int	fd;
+	void	(*func)(struct event *);
+	void	*arg;
+};
+
+extern	int	verbose;
+extern	int	daemon_mode;
+extern	int	dry_run;
+extern	int	refclock;
+
+/*
+ * gps_time.c
+ */
+void	detach();
+
+/*
+ * clock.c
+ */
+void	set_clock(struct gps_fix *);
+void	clock_deadline(int);
+void	ns_to_tv(int64_t, struct timeval *);
+
+/*
+ * filter.c
+ */
+void	filter_init(int);
+int	filter_add(int64_t);
+int	filter_count();
+int	filter_full();
+int64_t	filter_offset();
+
+/*
+ * loop.c
+ */
+void	loop_state(char *);
+int64_t	loop_remaining();
+void	loop_update(int64_t);
+void	loop_check();
+
+/*
+ * page.c
+ */
+void	page_open(char *);
+void	page_publish(struct gps_fix *);
+void	page_begin();
+void	page_end();
+
+/*
+ * pps.c
+ */
+void	pps_open(char *);
+void	pps_label(struct gps_fix *);
+
+/*
+ * receiver.c
+ */
+int	receiver_select(char *);
+void	receiver_config(int, int);
+
+/*
+ * refclock.c
+ */
+void	shm_open_unit(int);
+void	sock_open(char *);
+void	refclock_publish(struct gps_fix *);
+
+/*
+ * replay.c
+ */
+void	replay(char *, int);
+
+/*
+ * Convert a timespec to nanoseconds.
+ */
+static inline int64_t
+ts_ns(const struct timespec *tsp)
+{
+	return((int64_t )tsp->tv_sec * NSEC + tsp->tv_nsec);
+}
+
+/*
+ * event.c
+ */
+void	event_add(struct event *);
+void	event_del(struct event *);
+int	event_wait(int);
+
+#endif /* _GPS_TIME_H_ */
@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2022, Kalopa Robotics Limited.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of Kalopa Robotics nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL KALOPA ROBOTICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * The shared page holding the latest GPS fix, and how to read it.
+ */
+#ifndef _GPSPAGE_H_
+#define _GPSPAGE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define GPS_PAGE_MAGIC		0x47505350
+#define GPS_PAGE_VERSION	1
+
+/*
+ * The latest fix, as published by gps_time -M. The page is guarded by
+ * a sequence lock: gps_time makes the sequence number odd while it is
+ * updating the page, and even again once it's done, so readers never
+ * block it and never need a system call. All times are in nanoseconds.
+ * The receive times are when the GPS sent the fix, according to this
+ * host's realtime and monotonic clocks, so the age of a fix is the
+ * current CLOCK_MONOTONIC time less rx_mono.
+ */
+struct	gps_page	{
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	seq;
+	int32_t	valid;			/* Receiver status is 'A' */
+	int32_t	pps;			/* Time is from a PPS edge */
+	int32_t	nsats;			/* Satellites in use, or -1 */
+	int64_t	utc;			/* GPS time */
+	int64_t	rx_real;		/* CLOCK_REALTIME when sent */
+	int64_t	rx_mono;		/* CLOCK_MONOTONIC when sent */
+	int64_t	offset;			/* Estimated GPS time - system time */
+	uint64_t	nfixes;			/* Number of fixes published */
+};
+
+/*
+ * Take a consistent copy of the page. Returns zero on success, or -1
+ * if the page hasn't been set up (or nothing has been published yet).
+ */
+static inline int
+gps_page_read(const struct gps_page *pg, struct gps_page *copy)
+{
+	uint32_t seq;
+
+	do {
+		while ((seq = __atomic_load_n(&pg->seq, __ATOMIC_ACQUIRE)) & 1)
+			;
+		memcpy(copy, (const void *)pg, sizeof(*copy));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while (__atomic_load_n(&pg->seq, __ATOMIC_RELAXED) != seq);
+	if (copy->magic != GPS_PAGE_MAGIC || copy->version != GPS_PAGE_VERSION ||
+						copy->nfixes == 0)
+		return(-1);
+	return(0);
+}
+
+#endif /* _GPSPAGE_H_ */
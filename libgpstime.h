@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2022, Kalopa Robotics Limited.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of Kalopa Robotics nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL KALOPA ROBOTICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Public interface to the GPS time parser library.
+ */
+#ifndef _LIBGPSTIME_H_
+#define _LIBGPSTIME_H_
+
+#include <time.h>
+
+#define GPS_MAXLINE		512
+#define GPS_MAXFIELDS		24
+
+/*
+ * The result of scanning an NMEA sentence for delimiters.
+ */
+struct	gps_scan	{
+	int	csum;			/* XOR of everything before the '*' */
+	int	star;			/* Offset of the '*', or -1 if none */
+	int	nfields;		/* Number of comma-separated fields */
+	int	delim[GPS_MAXFIELDS];	/* Offset of each comma */
+};
+
+/*
+ * A single field within a sentence.
+ */
+struct	gps_field	{
+	int	offset;
+	int	length;
+};
+
+/*
+ * When some data arrived, according to the realtime and monotonic
+ * clocks.
+ */
+struct	gps_stamp	{
+	struct timespec	real;
+	struct timespec	mono;
+};
+
+/*
+ * A time fix decoded from the GPS, along with when the sentence
+ * started and finished arriving, and our best estimate of when the
+ * GPS started sending it.
+ */
+struct	gps_fix	{
+	struct timespec	utc;		/* The time, according to the GPS */
+	int	valid;			/* Receiver status is 'A' */
+	int	pps;			/* Epoch is from a second edge */
+	int	nsats;			/* Satellites in use, or -1 */
+	long	qerr;			/* Error of the time pulse (ps) */
+	struct gps_stamp	start;	/* Arrival of the first byte */
+	struct gps_stamp	end;	/* Arrival of the last byte */
+	struct gps_stamp	epoch;	/* Transmission of the reference byte */
+};
+
+/*
+ * The parser context. There is one of these for each stream of GPS
+ * data, and nothing is shared between them, so any number of streams
+ * can be parsed at once. The callbacks (either of which may be NULL)
+ * are called for each well-formed sentence, and for each time fix.
+ *
+ * If the baud rate is set, the time it takes to send each character
+ * is used to work back from the arrival of the end of a sentence to
+ * when the GPS started to send it (or, more precisely, started to send
+ * the reference character, where zero is the '$'). Otherwise, the
+ * arrival of the first byte is used.
+ *
+ * The status is whether the latest RMC or GGA sentence said the
+ * receiver had a fix. ZDA sentences don't say, so they go by that.
+ */
+struct	gps_parser	{
+	int	state;
+	int	inpos;
+	int	trailing;
+	int	verbose;
+	int	baud;
+	int	refchar;
+	int	nsats;
+	int	status;
+	long	qerr;
+	unsigned long	nsentences;
+	struct gps_stamp	start;
+	struct gps_stamp	end;
+	struct timespec	last;
+	void	*arg;
+	void	(*sentence)(struct gps_parser *, const char *, int,
+						struct gps_field *, int);
+	void	(*fix)(struct gps_parser *, struct gps_fix *);
+	char	input[GPS_MAXLINE];
+};
+
+/*
+ * nmea.c
+ */
+void	gps_init(struct gps_parser *);
+void	gps_feed(struct gps_parser *, const char *, int,
+					const struct gps_stamp *);
+void	gps_line(struct gps_parser *, const char *, int);
+void	gps_timefix(struct gps_parser *, int, struct gps_fix *);
+int	gps_tokenize(struct gps_scan *, struct gps_field [], int);
+int	gps_fieldvalue(const char *, struct gps_field *, int, int);
+int	gps_getvalue(const char *, int);
+int	gps_gethex(const char *, int);
+int	gps_gethms(const char *, int, struct gps_field *, int *, long *);
+int	gps_getdmy(const char *, int, struct gps_field *, int *, int *, int *);
+time_t	gps_utctime(int, int, int, int, int, int);
+
+/*
+ * scan.c
+ */
+void	gps_scan(const char *, int, struct gps_scan *);
+char	*gps_scan_select(const char *);
+
+/*
+ * ubx.c
+ */
+void	gps_ubx_message(struct gps_parser *, const char *, int);
+
+#endif /* _LIBGPSTIME_H_ */
@@ -0,0 +1,398 @@
+/*
+ * Copyright (c) 2022, Kalopa Robotics Limited.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of Kalopa Robotics nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL KALOPA ROBOTICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * The clock discipline loop. Each filtered offset is split into a
+ * phase correction, which the kernel slews out over the time constant,
+ * and a frequency correction, which we work out ourselves (a
+ * proportional-integral loop, where the kernel's PLL is just the
+ * proportional part). As the offsets settle down, the time constant is
+ * stretched, so the clock is corrected more gently and less often.
+ *
+ * If the fixes stop, the clock is kept running at the last frequency
+ * (allowing for its drift) until they come back. The frequency and
+ * drift can be kept in a state file, so that the loop doesn't have to
+ * learn them all over again after a restart.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#if defined(__has_include)
+#if __has_include(<sys/timex.h>)
+#define HAVE_TIMEX
+#include <sys/timex.h>
+#endif
+#endif
+
+#include "gps_time.h"
+
+#define MAXPHASE	(NSEC / 2)	/* Largest offset for the PLL */
+#define MAXFREQ		500000.0	/* Largest frequency (ppb) */
+#define MAXDRIFT	100.0		/* Largest drift (ppb/s) */
+#define MINTAU		16		/* Shortest time constant (s) */
+#define MAXTAU		1024		/* Longest time constant (s) */
+#define LIMIT		30		/* Updates before changing it */
+#define PGATE		4		/* Noise gate, in jitters */
+#define HOLDOVER	10		/* Seconds without a fix */
+#define SAVE_INTERVAL	600		/* Seconds between saves */
+
+/*
+ * The state of the loop. The frequency is ours, rather than the
+ * kernel's, and is in parts per billion. The drift is how fast it's
+ * changing (in ppb per second), measured each time the state is saved.
+ * The pll flag says which of the kernel's PLL or adjtime() was given
+ * the last correction, so that the other one can be cancelled when we
+ * switch between them.
+ */
+struct	loop	{
+	int	primed;
+	int	running;
+	int	pll;
+	int	holdover;
+	int	tau;
+	int	count;
+	double	freq;
+	double	drift;
+	double	jitter;
+	double	savedfreq;
+	double	holdfreq;
+	int64_t	last;
+	char	*statefile;
+	struct timespec	when;
+	struct timespec	saved;
+} loop;
+
+void	loop_slew(int64_t);
+#ifdef HAVE_TIMEX
+void	loop_pll(int64_t, double);
+void	loop_save(struct timespec *);
+void	set_freq(double);
+int	timeconst(int);
+#endif
+
+/*
+ * Use a state file for the frequency and drift, and start from what's
+ * in it (if anything). The kernel gets the frequency straight away, so
+ * the clock is about right even before the first fix. Anything out of
+ * range (which includes a NaN or an infinity) is ignored.
+ */
+void
+loop_state(char *path)
+{
+	FILE *fp;
+	double freq, drift;
+
+	loop.statefile = path;
+	if ((fp = fopen(path, "r")) == NULL)
+		return;
+	if (fscanf(fp, "%lf %lf", &freq, &drift) == 2 &&
+			freq >= -MAXFREQ && freq <= MAXFREQ &&
+			drift >= -MAXDRIFT && drift <= MAXDRIFT) {
+		loop.freq = loop.savedfreq = freq;
+		loop.drift = drift;
+		loop.primed = 1;
+		if (verbose)
+			printf("Frequency %+.3f ppm, drift %+.6f ppb/s, from %s.\n",
+					freq / 1e3, drift, path);
+#ifdef HAVE_TIMEX
+		set_freq(freq);
+#endif
+	}
+	fclose(fp);
+}
+
+/*
+ * How much of the last correction is still to be applied. The
+ * kernel's PLL offset is in nanoseconds (or microseconds, if it's
+ * not in nanosecond mode), and any adjtime() slew is on top of that.
+ */
+int64_t
+loop_remaining()
+{
+	int64_t remaining;
+	struct timeval olddelta;
+#ifdef HAVE_TIMEX
+	struct timex tx;
+#endif
+
+	if (adjtime(NULL, &olddelta) < 0) {
+		perror("gps_time: adjtime");
+		return(0);
+	}
+	remaining = olddelta.tv_sec * NSEC + olddelta.tv_usec * 1000LL;
+#ifdef HAVE_TIMEX
+	memset(&tx, 0, sizeof(tx));
+	if (ntp_adjtime(&tx) < 0) {
+		perror("gps_time: ntp_adjtime");
+		return(remaining);
+	}
+	if (tx.status & STA_PLL)
+		remaining += (tx.status & STA_NANO) ? tx.offset : tx.offset * 1000LL;
+#endif
+	return(remaining);
+}
+
+/*
+ * Correct the clock by a (filtered) offset. Anything too big for the
+ * PLL is slewed out with adjtime(), and the loop starts again once
+ * it's been brought in.
+ */
+void
+loop_update(int64_t offset)
+{
+	double interval;
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	interval = (ts_ns(&now) - ts_ns(&loop.when)) / 1e9;
+	loop.when = now;
+	if (loop.holdover) {
+		if (verbose)
+			printf("GPS is back, leaving holdover.\n");
+		loop.holdover = loop.running = 0;
+	}
+#ifdef HAVE_TIMEX
+	if (offset > -MAXPHASE && offset < MAXPHASE) {
+		loop_pll(offset, loop.running ? interval : 0.0);
+		return;
+	}
+#endif
+	loop_slew(offset);
+}
+
+/*
+ * Slew the clock with adjtime(), and leave the frequency alone. If the
+ * PLL was in use, whatever offset it still had is dropped first, or
+ * the two would both correct the same error.
+ */
+void
+loop_slew(int64_t offset)
+{
+	struct timeval delta;
+#ifdef HAVE_TIMEX
+	struct timex tx;
+
+	if (loop.pll) {
+		memset(&tx, 0, sizeof(tx));
+		tx.modes = MOD_OFFSET;
+		tx.offset = 0;
+		if (ntp_adjtime(&tx) < 0)
+			perror("gps_time: ntp_adjtime");
+		loop.pll = 0;
+	}
+#endif
+	if (verbose)
+		printf("Slewing %+.6f seconds.\n", offset / 1e9);
+	ns_to_tv(offset, &delta);
+	if (adjtime(&delta, NULL) < 0)
+		perror("gps_time: adjtime");
+	loop.running = 0;
+}
+
+/*
+ * Called every so often from the event loop. If there hasn't been a
+ * fix for a while, go into holdover: no more phase corrections, just
+ * keep the frequency where it was, plus however far it would have
+ * drifted since.
+ */
+void
+loop_check()
+{
+#ifdef HAVE_TIMEX
+	double elapsed;
+	struct timespec now;
+
+	if (!loop.running && !loop.holdover)
+		return;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	elapsed = (ts_ns(&now) - ts_ns(&loop.when)) / 1e9;
+	if (elapsed < HOLDOVER)
+		return;
+	if (!loop.holdover) {
+		if (verbose)
+			printf("No fix for %.0f seconds, going into holdover.\n", elapsed);
+		loop.holdover = 1;
+		loop.running = 0;
+		loop.holdfreq = loop.freq;
+	}
+	loop.freq = loop.holdfreq + loop.drift * elapsed;
+	if (loop.freq > MAXFREQ)
+		loop.freq = MAXFREQ;
+	else if (loop.freq < -MAXFREQ)
+		loop.freq = -MAXFREQ;
+	set_freq(loop.freq);
+#endif
+}
+
+#ifdef HAVE_TIMEX
+/*
+ * One update of the loop. The frequency is the integral of the offset,
+ * with a gain which falls with the square of the time constant. The
+ * kernel gets the offset itself (to slew out over the time constant)
+ * and our frequency, and is told to leave its own frequency estimate
+ * alone.
+ *
+ * The jitter is the average change from one offset to the next. While
+ * the offsets are within a few jitters of zero, the loop is locked, and
+ * once that has held for long enough the time constant is doubled. An
+ * offset outside that halves it again, more quickly.
+ *
+ * Coming from adjtime(), any slew still in progress is cancelled, as
+ * the offset we've just measured already includes what it had left.
+ */
+void
+loop_pll(int64_t offset, double interval)
+{
+	struct timex tx;
+	struct timeval zero;
+
+	if (!loop.pll) {
+		timerclear(&zero);
+		if (adjtime(&zero, NULL) < 0)
+			perror("gps_time: adjtime");
+		loop.pll = 1;
+	}
+	if (!loop.primed) {
+		/*
+		 * Start from whatever frequency the kernel already has.
+		 */
+		memset(&tx, 0, sizeof(tx));
+		if (ntp_adjtime(&tx) >= 0)
+			loop.freq = tx.freq / 65.536;
+		loop.primed = 1;
+	}
+	if (!loop.running) {
+		loop.running = 1;
+		loop.tau = MINTAU;
+		loop.count = 0;
+		loop.jitter = 0.0;
+		loop.last = offset;
+	}
+	loop.freq += offset * interval / (4.0 * loop.tau * loop.tau);
+	if (loop.freq > MAXFREQ)
+		loop.freq = MAXFREQ;
+	else if (loop.freq < -MAXFREQ)
+		loop.freq = -MAXFREQ;
+	loop.jitter += (llabs(offset - loop.last) - loop.jitter) / 8.0;
+	loop.last = offset;
+	if (llabs(offset) < PGATE * loop.jitter) {
+		if (++loop.count > LIMIT && loop.tau < MAXTAU) {
+			loop.tau *= 2;
+			loop.count = 0;
+		}
+	} else if ((loop.count -= 2) < -LIMIT && loop.tau > MINTAU) {
+		loop.tau /= 2;
+		loop.count = 0;
+	}
+	if (verbose)
+		printf("PLL offset %+.6f s, frequency %+.3f ppm, jitter %.6f s, time constant %d s.\n",
+				offset / 1e9, loop.freq / 1e3, loop.jitter / 1e9, loop.tau);
+	memset(&tx, 0, sizeof(tx));
+	tx.modes = MOD_OFFSET | MOD_FREQUENCY | MOD_STATUS | MOD_TIMECONST | MOD_NANO;
+	tx.status = STA_PLL | STA_FREQHOLD;
+	tx.offset = offset;
+	tx.freq = loop.freq * 65.536;
+	tx.constant = timeconst(loop.tau);
+	if (ntp_adjtime(&tx) < 0)
+		perror("gps_time: ntp_adjtime");
+	if (loop.statefile != NULL &&
+			loop.when.tv_sec - loop.saved.tv_sec >= SAVE_INTERVAL)
+		loop_save(&loop.when);
+}
+
+/*
+ * Save the frequency and drift, by writing a new state file and
+ * renaming it over the old one, so there's never half a file. Once
+ * the loop has settled down, the change in frequency since the last
+ * save goes into the drift estimate.
+ */
+void
+loop_save(struct timespec *nowp)
+{
+	int n;
+	double interval;
+	FILE *fp;
+	char tmpfile[1024];
+
+	interval = (ts_ns(nowp) - ts_ns(&loop.saved)) / 1e9;
+	if (loop.saved.tv_sec != 0 && loop.tau > MINTAU)
+		loop.drift += ((loop.freq - loop.savedfreq) / interval - loop.drift) / 4.0;
+	if (loop.drift > MAXDRIFT)
+		loop.drift = MAXDRIFT;
+	else if (loop.drift < -MAXDRIFT)
+		loop.drift = -MAXDRIFT;
+	loop.savedfreq = loop.freq;
+	loop.saved = *nowp;
+	n = snprintf(tmpfile, sizeof(tmpfile), "%s.tmp", loop.statefile);
+	if (n >= sizeof(tmpfile) || (fp = fopen(tmpfile, "w")) == NULL) {
+		perror("gps_time: state file");
+		return;
+	}
+	fprintf(fp, "%.3f %.9f\n", loop.freq, loop.drift);
+	if (fclose(fp) != 0 || rename(tmpfile, loop.statefile) < 0) {
+		perror("gps_time: state file");
+		unlink(tmpfile);
+	}
+}
+
+/*
+ * Give the kernel a new frequency.
+ */
+void
+set_freq(double freq)
+{
+	struct timex tx;
+
+	memset(&tx, 0, sizeof(tx));
+	tx.modes = MOD_FREQUENCY;
+	tx.freq = freq * 65.536;
+	if (ntp_adjtime(&tx) < 0)
+		perror("gps_time: ntp_adjtime");
+}
+
+/*
+ * The kernel's time constant for a loop time constant. The kernel
+ * slews out a quarter of the offset each second at its shortest
+ * constant of zero, and half as much for each one above that.
+ */
+int
+timeconst(int tau)
+{
+	int c;
+
+	for (c = 0; (4 << c) < tau && c < 10; c++)
+		;
+	return(c);
+}
+#endif
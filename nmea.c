@@ -0,0 +1,712 @@
+/*
+ * Copyright (c) 2022, Kalopa Robotics Limited.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of Kalopa Robotics nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL KALOPA ROBOTICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Parse a stream of NMEA data from a GPS, looking for the time. Any
+ * UBX binary messages mixed in with it are framed here too.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "libgpstime.h"
+
+#define ST_WAITNL		0
+#define ST_WAITDL		1
+#define ST_CAPTURE		2
+#define ST_UBX			3
+
+#define UBX_SYNC1		0xb5
+#define UBX_SYNC2		0x62
+#define UBX_HEADER		6
+#define UBX_OVERHEAD		8
+
+#define ISDIGIT(c)		((c) >= '0' && (c) <= '9')
+
+static	const char	*findeol(const char *, int);
+static	int	sentype(const char *, int);
+static	void	do_rmc(struct gps_parser *, const char *, int,
+						struct gps_field *, int);
+static	void	do_gga(struct gps_parser *, const char *, int,
+						struct gps_field *, int);
+static	void	do_zda(struct gps_parser *, const char *, int,
+						struct gps_field *, int);
+static	const char	*findsync(const char *, int);
+static	int	ubx_length(struct gps_parser *);
+static	void	epoch(struct gps_parser *, int, struct gps_stamp *);
+static	void	ts_back(struct timespec *, int64_t);
+static	int	swar6(const char *, int, int [3]);
+
+/*
+ * Initialise a parser context. The caller fills in the callbacks
+ * (and any private data) afterwards.
+ */
+void
+gps_init(struct gps_parser *gp)
+{
+	memset(gp, 0, sizeof(*gp));
+	gp->state = ST_WAITNL;
+	gp->nsats = -1;
+}
+
+/*
+ * Feed a block of serial data to the parser. Rather than looking at each
+ * character in turn, search the block for the start and end of each
+ * sentence and hand complete sentences to gps_line(). Where a sentence
+ * is wholly contained in the block, gps_line() gets a pointer straight
+ * into the read buffer. Only sentences which straddle two reads are
+ * copied into the parser's input[] buffer.
+ *
+ * A UBX sync character where a '$' might be starts a binary message
+ * instead. Its length is in the header, so it is collected (always in
+ * input[]) until it is all there, and then handed to gps_ubx_message().
+ *
+ * The timestamp (which may be NULL) says when the block arrived. A
+ * time fix carries the timestamps of the blocks which contained the
+ * start and the end of its sentence.
+ */
+void
+gps_feed(struct gps_parser *gp, const char *buf, int len,
+					const struct gps_stamp *tsp)
+{
+	const char *cp, *end = buf + len, *eol;
+	int n;
+
+	for (cp = buf; cp < end;) {
+		if (gp->state == ST_UBX) {
+			/*
+			 * Collect the header, and then the rest of the
+			 * message.
+			 */
+			if (gp->inpos < UBX_HEADER)
+				n = UBX_HEADER - gp->inpos;
+			else
+				n = ubx_length(gp) - gp->inpos;
+			if (n > end - cp)
+				n = end - cp;
+			memcpy(gp->input + gp->inpos, cp, n);
+			gp->inpos += n;
+			cp += n;
+			if (gp->inpos < UBX_HEADER)
+				return;
+			if ((unsigned char )gp->input[1] != UBX_SYNC2 ||
+					ubx_length(gp) > sizeof(gp->input)) {
+				/*
+				 * Not really a UBX message, or too long to be
+				 * one we care about.
+				 */
+				gp->state = ST_WAITDL;
+				continue;
+			}
+			if (gp->inpos < ubx_length(gp))
+				continue;
+			if (tsp != NULL)
+				gp->end = *tsp;
+			gp->trailing = end - cp;
+			gp->nsentences++;
+			gps_ubx_message(gp, gp->input, gp->inpos);
+			gp->state = ST_WAITDL;
+			continue;
+		}
+		eol = findeol(cp, end - cp);
+		if (gp->state == ST_WAITNL) {
+			/*
+			 * Skip to the end of the current line.
+			 */
+			if (eol == NULL)
+				return;
+			cp = eol + 1;
+			gp->state = ST_WAITDL;
+			continue;
+		}
+		if (gp->state == ST_WAITDL) {
+			/*
+			 * Look for the dollar-sign which starts the next
+			 * sentence (or the start of a UBX message).
+			 */
+			if ((cp = findsync(cp, end - cp)) == NULL)
+				return;
+			gp->inpos = 0;
+			if (*cp == '$') {
+				cp++;
+				gp->state = ST_CAPTURE;
+			} else
+				gp->state = ST_UBX;
+			if (tsp != NULL)
+				gp->start = *tsp;
+			continue;
+		}
+		/*
+		 * We're capturing a sentence. If the CR/NL isn't in this
+		 * block, save what we have and wait for more.
+		 */
+		n = (eol != NULL ? eol : end) - cp;
+		if (gp->inpos + n >= sizeof(gp->input) - 1) {
+			/*
+			 * Line is too long. Dump it.
+			 */
+			gp->state = ST_WAITNL;
+			continue;
+		}
+		if (eol == NULL) {
+			memcpy(gp->input + gp->inpos, cp, n);
+			gp->inpos += n;
+			return;
+		}
+		/*
+		 * Saw a CR/NL. Process the line, straight from the read
+		 * buffer if we can.
+		 */
+		if (tsp != NULL)
+			gp->end = *tsp;
+		gp->trailing = end - eol - 1;
+		gp->nsentences++;
+		if (gp->inpos == 0)
+			gps_line(gp, cp, n);
+		else {
+			memcpy(gp->input + gp->inpos, cp, n);
+			gp->inpos += n;
+			gps_line(gp, gp->input, gp->inpos);
+		}
+		cp = eol + 1;
+		gp->state = ST_WAITDL;
+	}
+}
+
+/*
+ * Find the first '$' or UBX sync character in a block of data.
+ */
+static const char *
+findsync(const char *strp, int len)
+{
+	const char *dp, *up;
+
+	if ((dp = memchr(strp, '$', len)) != NULL)
+		len = dp - strp;
+	if ((up = memchr(strp, UBX_SYNC1, len)) != NULL)
+		return(up);
+	return(dp);
+}
+
+/*
+ * The total length of the UBX message being collected, from its header.
+ */
+static int
+ubx_length(struct gps_parser *gp)
+{
+	unsigned char *hp = (unsigned char *)gp->input;
+
+	return((hp[4] | hp[5] << 8) + UBX_OVERHEAD);
+}
+
+/*
+ * Find the first CR or NL in a block of data.
+ */
+static const char *
+findeol(const char *strp, int len)
+{
+	const char *nl, *cr;
+
+	if ((nl = memchr(strp, '\n', len)) != NULL)
+		len = nl - strp;
+	if ((cr = memchr(strp, '\r', len)) != NULL)
+		return(cr);
+	return(nl);
+}
+
+/*
+ * The sentence types we understand. They are recognised by the three
+ * characters after the talker ID (so a GNRMC is just as good as a
+ * GPRMC), packed into a single word and looked up with a switch.
+ */
+#define TYPE(a, b, c)		((a) << 16 | (b) << 8 | (c))
+
+#define S_OTHER			0
+#define S_RMC			1
+#define S_GGA			2
+#define S_ZDA			3
+
+static	void	(*handlers[])(struct gps_parser *, const char *, int,
+						struct gps_field *, int) = {
+	NULL,
+	do_rmc,
+	do_gga,
+	do_zda
+};
+
+/*
+ * Handle a single line of GPS data. Every well-formed sentence is
+ * passed to the sentence callback, but really we only care about the
+ * ones with the time in them (RMC and ZDA, from any talker).
+ */
+void
+gps_line(struct gps_parser *gp, const char *line, int len)
+{
+	int n, type;
+	struct gps_scan sc;
+	struct gps_field fields[GPS_MAXFIELDS];
+
+	if (gp->verbose)
+		printf("GPS: [%.*s]\n", len, line);
+	/*
+	 * If nobody wants to see the other sentences, don't waste any
+	 * time on them.
+	 */
+	type = sentype(line, len);
+	if (gp->sentence == NULL && type == S_OTHER) {
+		if (gp->verbose)
+			printf("Waiting for an RMC or ZDA message - ignoring this one...\n");
+		return;
+	}
+	/*
+	 * Find the field delimiters and compute the checksum, all in
+	 * one pass.
+	 */
+	gps_scan(line, len, &sc);
+	/*
+	 * No checksum? Dunno what that was - ditch it.
+	 */
+	if (sc.star < 0) {
+		if (gp->verbose)
+			printf("?Badly formed NMEA sentence - ignoring...\n");
+		return;
+	}
+	/*
+	 * Compare the checksum we computed versus the one at the
+	 * end of the sentence.
+	 */
+	if (len - sc.star < 3 || gps_gethex(line + sc.star + 1, 2) != sc.csum) {
+		if (gp->verbose)
+			printf("?Invalid checksum - ignoring...\n");
+		return;
+	}
+	if (gp->verbose)
+		printf("Checksum is good.\n");
+	/*
+	 * Split the sentence into its arguments (comma-based).
+	 */
+	if ((n = gps_tokenize(&sc, fields, GPS_MAXFIELDS)) == 0) {
+		if (gp->verbose)
+			printf("?Too many fields in NMEA sentence - ignoring...\n");
+		return;
+	}
+	if (gp->sentence != NULL)
+		gp->sentence(gp, line, len, fields, n);
+	if (type == S_OTHER) {
+		if (gp->verbose)
+			printf("Waiting for an RMC or ZDA message - ignoring this one...\n");
+		return;
+	}
+	handlers[type](gp, line, len, fields, n);
+}
+
+/*
+ * Work out the type of a sentence from its address field. Any talker
+ * will do, but proprietary sentences ($P...) are something else
+ * altogether.
+ */
+static int
+sentype(const char *line, int len)
+{
+	if (len < 6 || line[0] == 'P' || line[5] != ',')
+		return(S_OTHER);
+	switch (TYPE(line[2], line[3], line[4])) {
+	case TYPE('R', 'M', 'C'):
+		return(S_RMC);
+
+	case TYPE('G', 'G', 'A'):
+		return(S_GGA);
+
+	case TYPE('Z', 'D', 'A'):
+		return(S_ZDA);
+	}
+	return(S_OTHER);
+}
+
+/*
+ * An RMC sentence has the time, the date and the receiver status.
+ */
+static void
+do_rmc(struct gps_parser *gp, const char *line, int len,
+				struct gps_field *fields, int n)
+{
+	int secs, year, mon, mday;
+	struct gps_fix fix;
+
+	/*
+	 * Depending on the NMEA version, there may or may not be a mode
+	 * indicator and a navigational status on the end.
+	 */
+	if (n < 12 || n > 14) {
+		if (gp->verbose)
+			printf("Incorrect number of RMC paramaters in sentence...\n");
+		return;
+	}
+	if (gp->verbose) {
+		/*
+		 * Show the encoded time and date fields.
+		 */
+		printf("GPS Time: %.*s\n", fields[1].length, line + fields[1].offset);
+		printf("GPS Date: %.*s\n", fields[9].length, line + fields[9].offset);
+	}
+	/*
+	 * Work out the time from the data in the sentence. Note
+	 * that the year is a bit Y2K, but what can ya do.
+	 */
+	if (gps_gethms(line, len, &fields[1], &secs, &fix.utc.tv_nsec) < 0 ||
+			gps_getdmy(line, len, &fields[9], &year, &mon, &mday) < 0) {
+		if (gp->verbose)
+			printf("?Invalid time or date in RMC sentence - ignoring...\n");
+		return;
+	}
+	fix.utc.tv_sec = gps_utctime(year + 2000, mon, mday, 0, 0, 0) + secs;
+	fix.valid = fields[2].length == 1 && line[fields[2].offset] == 'A';
+	gp->status = fix.valid;
+	gps_timefix(gp, len + 2, &fix);
+}
+
+/*
+ * GGA sentences don't have the date, but they do tell us how many
+ * satellites are in use, and whether there's a fix (quality zero
+ * means there isn't).
+ */
+static void
+do_gga(struct gps_parser *gp, const char *line, int len,
+				struct gps_field *fields, int n)
+{
+	if (n >= 7 && fields[6].length > 0)
+		gp->status = line[fields[6].offset] != '0';
+	if (n >= 8 && fields[7].length > 0)
+		gp->nsats = gps_fieldvalue(line, &fields[7], 0, 2);
+}
+
+/*
+ * A ZDA sentence has the time and date (with a four digit year, for
+ * once), but no status. Some receivers send it from their real-time
+ * clock before they have a fix, so it's only as good as the status
+ * in the latest RMC or GGA sentence.
+ */
+static void
+do_zda(struct gps_parser *gp, const char *line, int len,
+				struct gps_field *fields, int n)
+{
+	int secs, year, mon, mday;
+	struct gps_fix fix;
+
+	if (n < 5) {
+		if (gp->verbose)
+			printf("Incorrect number of ZDA paramaters in sentence...\n");
+		return;
+	}
+	if (gp->verbose) {
+		printf("GPS Time: %.*s\n", fields[1].length, line + fields[1].offset);
+		printf("GPS Date: %.*s/%.*s/%.*s\n",
+				fields[2].length, line + fields[2].offset,
+				fields[3].length, line + fields[3].offset,
+				fields[4].length, line + fields[4].offset);
+	}
+	if (gps_gethms(line, len, &fields[1], &secs, &fix.utc.tv_nsec) < 0 ||
+			fields[2].length != 2 || fields[3].length != 2 ||
+			fields[4].length != 4) {
+		if (gp->verbose)
+			printf("?Invalid time or date in ZDA sentence - ignoring...\n");
+		return;
+	}
+	mday = gps_fieldvalue(line, &fields[2], 0, 2);
+	mon = gps_fieldvalue(line, &fields[3], 0, 2);
+	year = gps_fieldvalue(line, &fields[4], 0, 4);
+	if (mday < 1 || mday > 31 || mon < 1 || mon > 12 || year < 1980) {
+		if (gp->verbose)
+			printf("?Invalid time or date in ZDA sentence - ignoring...\n");
+		return;
+	}
+	fix.utc.tv_sec = gps_utctime(year, mon, mday, 0, 0, 0) + secs;
+	fix.valid = gp->status;
+	gps_timefix(gp, len + 2, &fix);
+}
+
+/*
+ * Fill in the rest of a time fix and pass it on. The size is that of
+ * the whole sentence or message the time came from. A receiver sending
+ * both RMC and ZDA (or more than one UBX time message) will tell us the
+ * same time twice, and only the first one is any use.
+ */
+void
+gps_timefix(struct gps_parser *gp, int size, struct gps_fix *fp)
+{
+	if (fp->utc.tv_sec == gp->last.tv_sec &&
+				fp->utc.tv_nsec == gp->last.tv_nsec) {
+		if (gp->verbose)
+			printf("Already seen this time - ignoring...\n");
+		return;
+	}
+	gp->last = fp->utc;
+	fp->pps = 0;
+	fp->nsats = gp->nsats;
+	fp->qerr = gp->qerr;
+	gp->qerr = 0;
+	fp->start = gp->start;
+	fp->end = gp->end;
+	epoch(gp, size, &fp->epoch);
+	/*
+	 * Let the caller know we have a time fix.
+	 */
+	if (gp->fix != NULL)
+		gp->fix(gp, fp);
+}
+
+/*
+ * Convert a UTC date and time to seconds since the epoch. Unlike
+ * mktime(), this doesn't care about the local timezone (or need to
+ * look it up). The days are counted in 400-year eras, with each year
+ * starting in March so that the leap day is at the end.
+ */
+time_t
+gps_utctime(int year, int mon, int mday, int hour, int min, int sec)
+{
+	int era, yoe, doy;
+	int64_t days;
+
+	year -= (mon <= 2);
+	era = (year >= 0 ? year : year - 399) / 400;
+	yoe = year - era * 400;
+	doy = (153 * (mon > 2 ? mon - 3 : mon + 9) + 2) / 5 + mday - 1;
+	days = (int64_t )era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+	return(days * 86400 + hour * 3600 + min * 60 + sec);
+}
+
+/*
+ * Work out when the GPS started to send the reference character of a
+ * sentence. The last block of data arrived just after its final byte,
+ * and each byte before that took ten bit-times (start, eight data
+ * bits and a stop bit) to send. The sentence (from the '$' to the
+ * CR or NL which ended it, or the whole of a UBX message) is size
+ * bytes long, and is followed by whatever else was in the block
+ * (including the NL of a CR/NL pair). A reference character beyond
+ * the end of the sentence is taken to be its last.
+ */
+static void
+epoch(struct gps_parser *gp, int size, struct gps_stamp *sp)
+{
+	int ref;
+	int64_t ns;
+
+	if (gp->baud <= 0) {
+		*sp = gp->start;
+		return;
+	}
+	if ((ref = gp->refchar) >= size)
+		ref = size - 1;
+	else if (ref < 0)
+		ref = 0;
+	ns = (gp->trailing + size - ref) * 10000000000LL / gp->baud;
+	*sp = gp->end;
+	ts_back(&sp->real, ns);
+	ts_back(&sp->mono, ns);
+}
+
+/*
+ * Move a timestamp back by some number of nanoseconds.
+ */
+static void
+ts_back(struct timespec *tsp, int64_t ns)
+{
+	tsp->tv_sec -= ns / 1000000000;
+	if ((tsp->tv_nsec -= ns % 1000000000) < 0) {
+		tsp->tv_sec--;
+		tsp->tv_nsec += 1000000000;
+	}
+}
+
+/*
+ * Convert the delimiters found by gps_scan() into a set of field spans
+ * (offset and length). The sentence itself is left untouched. Empty
+ * fields, including any on the end, have a length of zero. Returns
+ * the number of fields, or zero if there were too many.
+ */
+int
+gps_tokenize(struct gps_scan *sp, struct gps_field fields[], int maxfields)
+{
+	int n, start = 0;
+
+	if (sp->nfields > maxfields || sp->nfields > GPS_MAXFIELDS)
+		return(0);
+	for (n = 0; n < sp->nfields - 1; n++) {
+		fields[n].offset = start;
+		fields[n].length = sp->delim[n] - start;
+		start = sp->delim[n] + 1;
+	}
+	fields[n].offset = start;
+	fields[n].length = sp->star - start;
+	return(n + 1);
+}
+
+/*
+ * Get a numeric value from part of a field. Only the digits which
+ * are actually within the field are considered.
+ */
+int
+gps_fieldvalue(const char *line, struct gps_field *fp, int offset, int ndigits)
+{
+	if (offset >= fp->length)
+		return(0);
+	if (ndigits > fp->length - offset)
+		ndigits = fp->length - offset;
+	return(gps_getvalue(line + fp->offset + offset, ndigits));
+}
+
+/*
+ * Get a numeric value from a string.
+ */
+int
+gps_getvalue(const char *strp, int ndigits)
+{
+	int value = 0;
+
+	while (ndigits-- && ISDIGIT(*strp))
+		value = value * 10 + *strp++ - '0';
+	return(value);
+}
+
+/*
+ * Get a hexadecimal value from a string.
+ */
+int
+gps_gethex(const char *strp, int ndigits)
+{
+	int value = 0;
+
+	while (ndigits--) {
+		if (ISDIGIT(*strp))
+			value = (value << 4) + *strp++ - '0';
+		else if (*strp >= 'A' && *strp <= 'F')
+			value = (value << 4) + *strp++ - 'A' + 10;
+		else if (*strp >= 'a' && *strp <= 'f')
+			value = (value << 4) + *strp++ - 'a' + 10;
+		else
+			break;
+	}
+	return(value);
+}
+
+/*
+ * Decode an hhmmss[.sss] time field into seconds since midnight and
+ * nanoseconds. Returns -1 if the field is malformed or out of range.
+ */
+int
+gps_gethms(const char *line, int len, struct gps_field *fp, int *secsp, long *nsecp)
+{
+	int v[3], n;
+	const char *cp = line + fp->offset;
+
+	if (fp->length < 6 || swar6(cp, len - fp->offset, v) < 0)
+		return(-1);
+	if (v[0] > 23 || v[1] > 59 || v[2] > 60)
+		return(-1);
+	*secsp = v[0] * 3600 + v[1] * 60 + v[2];
+	/*
+	 * Any fraction of a second can be to any number of places
+	 * (although only the first nine count).
+	 */
+	*nsecp = 0;
+	if (fp->length == 6)
+		return(0);
+	if (cp[6] != '.')
+		return(-1);
+	for (cp += 7, n = 0; cp < line + fp->offset + fp->length; cp++, n++) {
+		if (!ISDIGIT(*cp))
+			return(-1);
+		if (n < 9)
+			*nsecp = *nsecp * 10 + *cp - '0';
+	}
+	for (; n < 9; n++)
+		*nsecp *= 10;
+	return(0);
+}
+
+/*
+ * Decode a ddmmyy date field. Returns -1 if the field is malformed or
+ * out of range.
+ */
+int
+gps_getdmy(const char *line, int len, struct gps_field *fp, int *yearp, int *monp, int *mdayp)
+{
+	int v[3];
+
+	if (fp->length != 6 || swar6(line + fp->offset, len - fp->offset, v) < 0)
+		return(-1);
+	if (v[0] < 1 || v[0] > 31 || v[1] < 1 || v[1] > 12)
+		return(-1);
+	*mdayp = v[0];
+	*monp = v[1];
+	*yearp = v[2];
+	return(0);
+}
+
+/*
+ * Decode six digits as three two-digit values, all at once, using a
+ * single eight-byte load (avail says how many bytes it's safe to read).
+ * The first six bytes must all be digits: subtracting '0' from a byte
+ * below '0', or adding 0x46 to a byte above '9', sets its top bit. Then
+ * each pair of digits is combined as ten times the first, plus the
+ * second. Returns -1 if they aren't all digits.
+ */
+static int
+swar6(const char *strp, int avail, int v[3])
+{
+	uint64_t x;
+	char buf[8];
+
+	if (avail >= 8)
+		memcpy(&x, strp, 8);
+	else {
+		memset(buf, 0, sizeof(buf));
+		memcpy(buf, strp, avail < 6 ? avail : 6);
+		memcpy(&x, buf, 8);
+	}
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	x = __builtin_bswap64(x);
+#endif
+	x &= 0x0000ffffffffffffULL;
+	if (((x | (x - 0x0000303030303030ULL) | (x + 0x0000464646464646ULL)) &
+					0x0000808080808080ULL) != 0)
+		return(-1);
+	x -= 0x0000303030303030ULL;
+	x = (x * 10 + (x >> 8)) & 0x000000ff00ff00ffULL;
+	v[0] = x & 0xff;
+	v[1] = (x >> 16) & 0xff;
+	v[2] = (x >> 32) & 0xff;
+	return(0);
+}
+
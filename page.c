@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2022, Kalopa Robotics Limited.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of Kalopa Robotics nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL KALOPA ROBOTICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Publish the latest fix in a shared page, for lock-free readers.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "gps_time.h"
+#include "gpspage.h"
+
+static	struct gps_page	*page = NULL;
+
+/*
+ * Create (or reuse) the file holding the page, and map it.
+ */
+void
+page_open(char *path)
+{
+	int fd;
+	long size = sysconf(_SC_PAGESIZE);
+
+	if (verbose)
+		printf("Fix page: %s\n", path);
+	if ((fd = open(path, O_RDWR|O_CREAT, 0644)) < 0) {
+		fprintf(stderr, "gps_time: ");
+		perror(path);
+		exit(1);
+	}
+	if (size < sizeof(struct gps_page))
+		size = sizeof(struct gps_page);
+	if (ftruncate(fd, size) < 0) {
+		perror("gps_time: ftruncate");
+		exit(1);
+	}
+	page = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	if (page == MAP_FAILED) {
+		perror("gps_time: mmap");
+		exit(1);
+	}
+	close(fd);
+	/*
+	 * Start from scratch, leaving the sequence number alone in case
+	 * anyone is already reading. If it's odd, the last writer died in
+	 * the middle of an update, which we may as well carry on with;
+	 * starting another would leave the sequence number odd whenever
+	 * the page wasn't being written.
+	 */
+	if ((__atomic_load_n(&page->seq, __ATOMIC_RELAXED) & 1) == 0)
+		page_begin();
+	page->magic = GPS_PAGE_MAGIC;
+	page->version = GPS_PAGE_VERSION;
+	page->nfixes = 0;
+	page_end();
+}
+
+/*
+ * Publish a fix.
+ */
+void
+page_publish(struct gps_fix *fp)
+{
+	if (page == NULL)
+		return;
+	page_begin();
+	page->valid = fp->valid;
+	page->pps = fp->pps;
+	page->nsats = fp->nsats;
+	page->utc = ts_ns(&fp->utc);
+	page->rx_real = ts_ns(&fp->epoch.real);
+	page->rx_mono = ts_ns(&fp->epoch.mono);
+	page->offset = page->utc - page->rx_real;
+	page->nfixes++;
+	page_end();
+}
+
+/*
+ * Start an update. Make the sequence number odd, and make sure that's
+ * visible before any of the changes.
+ */
+void
+page_begin()
+{
+	__atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/*
+ * Finish an update, making the sequence number even again once all of
+ * the changes are visible.
+ */
+void
+page_end()
+{
+	__atomic_store_n(&page->seq, page->seq + 1, __ATOMIC_RELEASE);
+}
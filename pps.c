@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2022, Kalopa Robotics Limited.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of Kalopa Robotics nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL KALOPA ROBOTICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Pair second-edge (PPS) timestamps with the GPS time sentences.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#if defined(__has_include)
+#if __has_include(<sys/timepps.h>)
+#define HAVE_TIMEPPS
+#include <sys/timepps.h>
+#endif
+#endif
+
+#include "gps_time.h"
+
+/*
+ * The edge source. This is either a kernel PPS device, read through
+ * the RFC 2783 API, or something (such as a FIFO or a pty) which
+ * gives us the realtime timestamp of each edge as a line of text.
+ */
+struct	pps	{
+	char	*name;
+	int	fd;
+	int	have_edge;
+	struct event	event;
+	struct gps_stamp	edge;
+	char	line[64];
+	int	len;
+#ifdef HAVE_TIMEPPS
+	int	kernel;
+	pps_handle_t	handle;
+	unsigned long	seq;
+#endif
+} pps;
+
+void	pps_read(struct event *);
+void	pps_text(char *, struct gps_stamp *);
+void	pps_edge(struct timespec *, struct gps_stamp *);
+void	ts_shift(struct timespec *, long);
+#ifdef HAVE_TIMEPPS
+void	pps_fetch();
+#endif
+
+/*
+ * Open the edge source.
+ */
+void
+pps_open(char *name)
+{
+	struct termios tios;
+
+	pps.name = name;
+	if (verbose)
+		printf("PPS source: %s\n", name);
+	if (strncmp(name, "/dev/pps", 8) == 0) {
+#ifdef HAVE_TIMEPPS
+		pps_params_t params;
+
+		if ((pps.fd = open(name, O_RDWR)) < 0) {
+			fprintf(stderr, "gps_time: ");
+			perror(name);
+			exit(1);
+		}
+		if (time_pps_create(pps.fd, &pps.handle) < 0 ||
+				time_pps_getparams(pps.handle, &params) < 0) {
+			perror("gps_time: time_pps_create");
+			exit(1);
+		}
+		params.mode |= PPS_CAPTUREASSERT | PPS_TSFMT_TSPEC;
+		if (time_pps_setparams(pps.handle, &params) < 0) {
+			perror("gps_time: time_pps_setparams");
+			exit(1);
+		}
+		pps.kernel = 1;
+		return;
+#else
+		fprintf(stderr, "gps_time: no kernel PPS support.\n");
+		exit(1);
+#endif
+	}
+	/*
+	 * A text source. Open a FIFO for writing as well as reading, so
+	 * that we don't see an end-of-file each time the writer goes
+	 * away. If it's a tty, put it into raw mode.
+	 */
+	if ((pps.fd = open(name, O_RDWR|O_NOCTTY|O_NONBLOCK)) < 0) {
+		fprintf(stderr, "gps_time: ");
+		perror(name);
+		exit(1);
+	}
+	if (isatty(pps.fd) && tcgetattr(pps.fd, &tios) == 0) {
+		tios.c_iflag &= ~(ICRNL | INLCR | IXON);
+		tios.c_lflag &= ~(ECHO | ECHONL | ICANON | IEXTEN | ISIG);
+		tios.c_cc[VMIN] = 1;
+		tios.c_cc[VTIME] = 0;
+		tcsetattr(pps.fd, TCSANOW, &tios);
+	}
+	pps.event.fd = pps.fd;
+	pps.event.func = pps_read;
+	pps.event.arg = &pps;
+	event_add(&pps.event);
+}
+
+/*
+ * Read edge timestamps from a text source, one per line. If the source
+ * goes away (a pty whose other end has been closed, say), stop
+ * watching it, and carry on without edges.
+ */
+void
+pps_read(struct event *evp)
+{
+	int n;
+	char *cp, *ep;
+	struct gps_stamp now;
+
+	n = read(pps.fd, pps.line + pps.len, sizeof(pps.line) - pps.len - 1);
+	clock_gettime(CLOCK_REALTIME, &now.real);
+	clock_gettime(CLOCK_MONOTONIC, &now.mono);
+	if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+		return;
+	if (n <= 0) {
+		if (n < 0)
+			perror(pps.name);
+		else if (verbose)
+			printf("%s: end of file.\n", pps.name);
+		event_del(evp);
+		close(pps.fd);
+		pps.fd = -1;
+		return;
+	}
+	pps.len += n;
+	pps.line[pps.len] = '\0';
+	for (cp = pps.line; (ep = strchr(cp, '\n')) != NULL; cp = ep + 1) {
+		*ep = '\0';
+		pps_text(cp, &now);
+	}
+	if ((pps.len -= cp - pps.line) == sizeof(pps.line) - 1)
+		pps.len = 0;
+	memmove(pps.line, cp, pps.len);
+}
+
+/*
+ * Decode a text timestamp, of the form seconds.nanoseconds.
+ */
+void
+pps_text(char *strp, struct gps_stamp *nowp)
+{
+	int n;
+	struct timespec ts;
+
+	ts.tv_sec = 0;
+	ts.tv_nsec = 0;
+	while (isdigit(*strp))
+		ts.tv_sec = ts.tv_sec * 10 + *strp++ - '0';
+	if (*strp == '.') {
+		for (n = 0, strp++; n < 9; n++) {
+			ts.tv_nsec *= 10;
+			if (isdigit(*strp))
+				ts.tv_nsec += *strp++ - '0';
+		}
+	}
+	if (*strp != '\0' && *strp != '\r') {
+		if (verbose)
+			printf("?Bad PPS timestamp - ignoring...\n");
+		return;
+	}
+	pps_edge(&ts, nowp);
+}
+
+/*
+ * We have the (realtime) timestamp of an edge. Work out when it
+ * happened according to the monotonic clock too, using the time we
+ * found out about it.
+ */
+void
+pps_edge(struct timespec *tsp, struct gps_stamp *nowp)
+{
+	int64_t age;
+
+	age = ts_ns(&nowp->real) - ts_ns(tsp);
+	if (age < 0 || age >= NSEC) {
+		if (verbose)
+			printf("?Stale PPS timestamp - ignoring...\n");
+		return;
+	}
+	pps.edge.real = *tsp;
+	pps.edge.mono = nowp->mono;
+	if ((pps.edge.mono.tv_nsec -= age % NSEC) < 0) {
+		pps.edge.mono.tv_sec--;
+		pps.edge.mono.tv_nsec += NSEC;
+	}
+	pps.have_edge = 1;
+	if (verbose)
+		printf("PPS edge at %lld.%09ld\n", (long long )tsp->tv_sec, tsp->tv_nsec);
+}
+
+#ifdef HAVE_TIMEPPS
+/*
+ * Ask the kernel for the latest edge.
+ */
+void
+pps_fetch()
+{
+	pps_info_t info;
+	struct gps_stamp now;
+	struct timespec timeout = {0, 0};
+
+	if (time_pps_fetch(pps.handle, PPS_TSFMT_TSPEC, &info, &timeout) < 0) {
+		perror("gps_time: time_pps_fetch");
+		return;
+	}
+	if (info.assert_sequence == pps.seq)
+		return;
+	pps.seq = info.assert_sequence;
+	clock_gettime(CLOCK_REALTIME, &now.real);
+	clock_gettime(CLOCK_MONOTONIC, &now.mono);
+	pps_edge(&info.assert_timestamp, &now);
+}
+#endif
+
+/*
+ * We have a time fix. If it's for the top of a second, and the most
+ * recent edge was less than a second before the GPS started to send
+ * it, then the edge marks the start of that second. Use the time of
+ * the edge as the time of the fix. Each edge is only used once.
+ *
+ * If the receiver told us how far its pulse was from the true top of
+ * the second (the quantisation error, from a UBX TIM-TP message), the
+ * edge is moved back by that much.
+ */
+void
+pps_label(struct gps_fix *fp)
+{
+	int64_t delay;
+
+#ifdef HAVE_TIMEPPS
+	if (pps.kernel)
+		pps_fetch();
+#endif
+	if (!pps.have_edge || fp->utc.tv_nsec != 0)
+		return;
+	delay = ts_ns(&fp->epoch.mono) - ts_ns(&pps.edge.mono);
+	if (delay < 0 || delay >= NSEC)
+		return;
+	if (verbose)
+		printf("PPS edge labelled as %lld, %.3f ms before the sentence.\n",
+				(long long )fp->utc.tv_sec, delay / 1e6);
+	fp->epoch = pps.edge;
+	if (fp->qerr != 0) {
+		ts_shift(&fp->epoch.real, -fp->qerr / 1000);
+		ts_shift(&fp->epoch.mono, -fp->qerr / 1000);
+	}
+	fp->pps = 1;
+	pps.have_edge = 0;
+}
+
+/*
+ * Move a timestamp by a (small) number of nanoseconds.
+ */
+void
+ts_shift(struct timespec *tsp, long ns)
+{
+	if ((tsp->tv_nsec += ns) < 0) {
+		tsp->tv_sec--;
+		tsp->tv_nsec += NSEC;
+	} else if (tsp->tv_nsec >= NSEC) {
+		tsp->tv_sec++;
+		tsp->tv_nsec -= NSEC;
+	}
+}
@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2022, Kalopa Robotics Limited.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of Kalopa Robotics nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL KALOPA ROBOTICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Configure the GPS receiver when we open it. Turn off the sentences
+ * we don't use, so there's less on the wire to wade through, set the
+ * rate at which it sends the time, and optionally speed up the line.
+ * Each kind of receiver has its own commands for this.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+
+#include "gps_time.h"
+
+#define MAXRATE		10
+#define SEND_TIMEOUT	1000		/* Milliseconds to wait for the tty */
+
+void	mtk_config(int, int, int);
+void	ubx_config(int, int, int);
+void	nmea_send(int, char *);
+void	ubx_send(int, int, int, unsigned char *, int);
+void	send_all(int, const void *, int);
+
+struct	receiver	{
+	char	*name;
+	void	(*config)(int, int, int);
+} receivers[] = {
+	{"mtk", mtk_config},
+	{"ubx", ubx_config},
+	{NULL, NULL}
+};
+
+struct receiver	*rxp;
+int	rate = 1;
+
+/*
+ * Pick the kind of receiver (and optionally the number of fixes per
+ * second) from something like "ubx,5". Returns -1 if we don't know it.
+ */
+int
+receiver_select(char *spec)
+{
+	int len;
+	char *cp;
+
+	if ((cp = strchr(spec, ',')) != NULL) {
+		len = cp - spec;
+		rate = atoi(cp + 1);
+		if (rate < 1 || rate > MAXRATE)
+			return(-1);
+	} else
+		len = strlen(spec);
+	for (rxp = receivers; rxp->name != NULL; rxp++)
+		if (strlen(rxp->name) == len && strncmp(rxp->name, spec, len) == 0)
+			return(0);
+	rxp = NULL;
+	return(-1);
+}
+
+/*
+ * Send the configuration to a receiver. If there's a new baud rate,
+ * it's the last thing sent, and it's up to the caller to wait for it
+ * to go before changing the speed of the line.
+ */
+void
+receiver_config(int fd, int baud)
+{
+	if (rxp == NULL)
+		return;
+	if (verbose)
+		printf("Configuring %s receiver for %d fixes per second.\n",
+							rxp->name, rate);
+	rxp->config(fd, rate, baud);
+}
+
+/*
+ * MediaTek (and the many receivers built on their chips). PMTK314
+ * sets which sentences are sent (RMC, GGA and ZDA, here), PMTK220 the
+ * interval between fixes, and PMTK251 the baud rate.
+ */
+void
+mtk_config(int fd, int rate, int baud)
+{
+	char cmd[64];
+
+	nmea_send(fd, "PMTK314,0,1,0,1,0,0,0,0,0,0,0,0,0,0,0,0,0,1,0");
+	snprintf(cmd, sizeof(cmd), "PMTK220,%d", 1000 / rate);
+	nmea_send(fd, cmd);
+	if (baud > 0) {
+		snprintf(cmd, sizeof(cmd), "PMTK251,%d", baud);
+		nmea_send(fd, cmd);
+	}
+}
+
+/*
+ * u-blox. PUBX,40 turns each NMEA sentence on or off (on every port),
+ * and UBX-CFG-MSG turns on the binary time messages on this one.
+ * UBX-CFG-RATE sets the interval between fixes (aligned to UTC), and
+ * PUBX,41 sets the baud rate of the first serial port.
+ */
+void
+ubx_config(int fd, int rate, int baud)
+{
+	int i;
+	char cmd[64];
+	unsigned char payload[6];
+	static char *off[] = {"GSV", "GSA", "VTG", "GLL", NULL};
+	static char *on[] = {"RMC", "GGA", "ZDA", NULL};
+	static unsigned char msgs[][2] = {{0x01, 0x21}, {0x0d, 0x01}};
+
+	for (i = 0; off[i] != NULL; i++) {
+		snprintf(cmd, sizeof(cmd), "PUBX,40,%s,0,0,0,0,0,0", off[i]);
+		nmea_send(fd, cmd);
+	}
+	for (i = 0; on[i] != NULL; i++) {
+		snprintf(cmd, sizeof(cmd), "PUBX,40,%s,1,1,1,1,1,0", on[i]);
+		nmea_send(fd, cmd);
+	}
+	for (i = 0; i < 2; i++) {
+		payload[0] = msgs[i][0];
+		payload[1] = msgs[i][1];
+		payload[2] = 1;
+		ubx_send(fd, 0x06, 0x01, payload, 3);
+	}
+	payload[0] = (1000 / rate) & 0xff;
+	payload[1] = (1000 / rate) >> 8;
+	payload[2] = 1;
+	payload[3] = 0;
+	payload[4] = 0;
+	payload[5] = 0;
+	ubx_send(fd, 0x06, 0x08, payload, 6);
+	if (baud > 0) {
+		snprintf(cmd, sizeof(cmd), "PUBX,41,1,0007,0003,%d,0", baud);
+		nmea_send(fd, cmd);
+	}
+}
+
+/*
+ * Send an NMEA sentence, adding the '$', the checksum and the CR/NL.
+ */
+void
+nmea_send(int fd, char *body)
+{
+	int n, csum = 0;
+	char *cp, buf[GPS_MAXLINE];
+
+	for (cp = body; *cp != '\0'; cp++)
+		csum ^= *cp;
+	n = snprintf(buf, sizeof(buf), "$%s*%02X\r\n", body, csum);
+	if (verbose)
+		printf("Sending: %.*s\n", n - 2, buf);
+	send_all(fd, buf, n);
+}
+
+/*
+ * Send a UBX message, adding the sync characters, the header and the
+ * checksum.
+ */
+void
+ubx_send(int fd, int class, int id, unsigned char *payload, int len)
+{
+	int i;
+	unsigned char buf[64], cka = 0, ckb = 0;
+
+	buf[0] = 0xb5;
+	buf[1] = 0x62;
+	buf[2] = class;
+	buf[3] = id;
+	buf[4] = len & 0xff;
+	buf[5] = len >> 8;
+	memcpy(buf + 6, payload, len);
+	for (i = 2; i < len + 6; i++) {
+		cka += buf[i];
+		ckb += cka;
+	}
+	buf[len + 6] = cka;
+	buf[len + 7] = ckb;
+	if (verbose)
+		printf("Sending: UBX class 0x%02x id 0x%02x, %d bytes\n", class, id, len);
+	send_all(fd, buf, len + 8);
+}
+
+/*
+ * Write all of a command to the receiver. The tty is non-blocking, so
+ * a write can be short, or fail if the output queue is full, in which
+ * case wait for there to be room rather than send half a command.
+ */
+void
+send_all(int fd, const void *buf, int len)
+{
+	int n;
+	struct pollfd pfd;
+	const char *cp = buf;
+
+	while (len > 0) {
+		if ((n = write(fd, cp, len)) > 0) {
+			cp += n;
+			len -= n;
+			continue;
+		}
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
+			perror("gps_time: write");
+			return;
+		}
+		pfd.fd = fd;
+		pfd.events = POLLOUT;
+		if ((n = poll(&pfd, 1, SEND_TIMEOUT)) < 0 && errno == EINTR)
+			continue;
+		if (n <= 0) {
+			if (n < 0)
+				perror("gps_time: poll");
+			else
+				fprintf(stderr, "gps_time: timed out writing to the receiver.\n");
+			return;
+		}
+	}
+}
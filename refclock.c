@@ -0,0 +1,242 @@
+/*
+ * Copyright (c) 2022, Kalopa Robotics Limited.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of Kalopa Robotics nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL KALOPA ROBOTICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Feed GPS fixes to an NTP daemon, rather than setting the clock.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#include "gps_time.h"
+
+#define SHM_KEY			0x4e545030
+#define SOCK_MAGIC		0x534f434b
+
+/*
+ * The NTP shared memory segment, as understood by ntpd and chronyd.
+ */
+struct	shmTime	{
+	int	mode;
+	volatile int	count;
+	time_t	clockTimeStampSec;
+	int	clockTimeStampUSec;
+	time_t	receiveTimeStampSec;
+	int	receiveTimeStampUSec;
+	int	leap;
+	int	precision;
+	int	nsamples;
+	volatile int	valid;
+	unsigned	clockTimeStampNSec;
+	unsigned	receiveTimeStampNSec;
+	int	dummy[8];
+};
+
+/*
+ * A sample for chronyd's SOCK reference clock.
+ */
+struct	sock_sample	{
+	struct timeval	tv;
+	double	offset;
+	int	pulse;
+	int	leap;
+	int	_pad;
+	int	magic;
+};
+
+int	refclock;
+
+static	struct shmTime	*shm = NULL;
+static	char	*sock_path = NULL;
+static	int	sock_fd = -1;
+
+void	shm_publish(struct gps_fix *);
+void	sock_publish(struct gps_fix *);
+int	sock_connect();
+
+/*
+ * Attach to the NTP shared memory segment for the given unit. Units
+ * 0 and 1 are only accessible by root.
+ */
+void
+shm_open_unit(int unit)
+{
+	int id;
+
+	if (verbose)
+		printf("NTP SHM unit: %d\n", unit);
+	if ((id = shmget(SHM_KEY + unit, sizeof(struct shmTime),
+				IPC_CREAT | (unit < 2 ? 0600 : 0666))) < 0) {
+		perror("gps_time: shmget");
+		exit(1);
+	}
+	if ((shm = shmat(id, NULL, 0)) == (void *)-1) {
+		perror("gps_time: shmat");
+		exit(1);
+	}
+	shm->mode = 1;
+	shm->valid = 0;
+	shm->nsamples = 3;
+	refclock = 1;
+}
+
+/*
+ * Pass a fix to whichever reference clock outputs are enabled. Only
+ * fixes which the receiver says are valid are passed on.
+ */
+void
+refclock_publish(struct gps_fix *fp)
+{
+	if (!fp->valid)
+		return;
+	if (shm != NULL)
+		shm_publish(fp);
+	if (sock_path != NULL)
+		sock_publish(fp);
+}
+
+/*
+ * Write a fix into the shared memory segment, using the mode 1
+ * protocol. The count is bumped before and after the update, so
+ * that a reader can tell if it raced with us, and the sample isn't
+ * marked as valid until it's complete. The clock timestamp is the
+ * GPS time, and the receive timestamp is the system time at which
+ * the GPS sent it.
+ */
+void
+shm_publish(struct gps_fix *fp)
+{
+	shm->valid = 0;
+	shm->count++;
+	__sync_synchronize();
+	shm->clockTimeStampSec = fp->utc.tv_sec;
+	shm->clockTimeStampUSec = fp->utc.tv_nsec / 1000;
+	shm->clockTimeStampNSec = fp->utc.tv_nsec;
+	shm->receiveTimeStampSec = fp->epoch.real.tv_sec;
+	shm->receiveTimeStampUSec = fp->epoch.real.tv_nsec / 1000;
+	shm->receiveTimeStampNSec = fp->epoch.real.tv_nsec;
+	shm->leap = 0;
+	shm->precision = fp->pps ? -20 : -10;
+	__sync_synchronize();
+	shm->count++;
+	shm->valid = 1;
+	if (verbose)
+		printf("Published fix to NTP SHM.\n");
+}
+
+/*
+ * Send samples to chronyd's SOCK reference clock. chronyd creates the
+ * socket, so if it isn't there yet, keep trying.
+ */
+void
+sock_open(char *path)
+{
+	if (verbose)
+		printf("Chrony socket: %s\n", path);
+	if (strlen(path) >= sizeof(((struct sockaddr_un *)0)->sun_path)) {
+		fprintf(stderr, "gps_time: socket path too long: %s\n", path);
+		exit(1);
+	}
+	sock_path = path;
+	refclock = 1;
+	if (sock_connect() < 0)
+		perror(path);
+}
+
+/*
+ * Connect to the chronyd socket.
+ */
+int
+sock_connect()
+{
+	struct sockaddr_un sun;
+
+	if ((sock_fd = socket(AF_UNIX, SOCK_DGRAM, 0)) < 0) {
+		perror("gps_time: socket");
+		exit(1);
+	}
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strcpy(sun.sun_path, sock_path);
+	if (connect(sock_fd, (struct sockaddr *)&sun, sizeof(sun)) < 0) {
+		close(sock_fd);
+		return(sock_fd = -1);
+	}
+	return(0);
+}
+
+/*
+ * Send a sample to chronyd. The timestamp is the system time at which
+ * the GPS sent the fix, and the offset is the GPS time less that. When
+ * the time is from a PPS edge, say so - chronyd only uses the fraction
+ * of a second for pulses, so send the offset from the nearest second.
+ */
+void
+sock_publish(struct gps_fix *fp)
+{
+	int64_t offset;
+	struct sock_sample sample;
+
+	if (sock_fd < 0 && sock_connect() < 0)
+		return;
+	memset(&sample, 0, sizeof(sample));
+	sample.tv.tv_sec = fp->epoch.real.tv_sec;
+	sample.tv.tv_usec = fp->epoch.real.tv_nsec / 1000;
+	offset = ts_ns(&fp->utc) - ts_ns(&fp->epoch.real);
+	if (fp->pps) {
+		sample.pulse = 1;
+		if ((offset %= NSEC) >= NSEC / 2)
+			offset -= NSEC;
+		else if (offset < -NSEC / 2)
+			offset += NSEC;
+	}
+	sample.offset = offset / 1e9;
+	sample.magic = SOCK_MAGIC;
+	if (send(sock_fd, &sample, sizeof(sample), 0) != sizeof(sample)) {
+		if (verbose)
+			printf("?Chrony socket: %s\n", strerror(errno));
+		close(sock_fd);
+		sock_fd = -1;
+		return;
+	}
+	if (verbose)
+		printf("Sent %s sample to chrony, offset %+.9f.\n",
+				fp->pps ? "PPS" : "NMEA", sample.offset);
+}
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2022, Kalopa Robotics Limited.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of Kalopa Robotics nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL KALOPA ROBOTICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Replay a file of recorded NMEA data through the parser.
+ */
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "gps_time.h"
+
+#define CHUNK_SIZE		65536
+#define PACE_INTERVAL		10000000LL
+
+void	replay_fix(struct gps_parser *, struct gps_fix *);
+
+static	unsigned long	nfixes;
+
+/*
+ * Replay a capture file. The file is mapped into memory and fed to the
+ * parser, either as fast as possible or (if a baud rate is given) at
+ * the speed it would have arrived from the GPS. Nothing is done to the
+ * system clock - each fix is just reported.
+ */
+void
+replay(char *file, int baud)
+{
+	int fd, n;
+	char *data;
+	off_t off;
+	int64_t elapsed, chunk, next;
+	struct stat st;
+	struct gps_stamp stamp;
+	struct timespec start, ts;
+	struct gps_parser parser;
+
+	if ((fd = open(file, O_RDONLY)) < 0 || fstat(fd, &st) < 0) {
+		fprintf(stderr, "gps_time: ");
+		perror(file);
+		exit(1);
+	}
+	if (st.st_size == 0)
+		exit(0);
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		perror("gps_time: mmap");
+		exit(1);
+	}
+	madvise(data, st.st_size, MADV_SEQUENTIAL);
+	/*
+	 * We want to see every fix, not just the first.
+	 */
+	dry_run = daemon_mode = 1;
+	gps_init(&parser);
+	parser.verbose = verbose;
+	parser.fix = replay_fix;
+	/*
+	 * When pacing, send the data in chunks of however much would
+	 * arrive in each interval, and note the arrival time of each.
+	 */
+	chunk = CHUNK_SIZE;
+	if (baud > 0) {
+		parser.baud = baud;
+		if ((chunk = baud * PACE_INTERVAL / (10 * NSEC)) < 1)
+			chunk = 1;
+	}
+	if (verbose)
+		printf("Replaying %s (%lld bytes) in chunks of %lld bytes.\n",
+				file, (long long )st.st_size, (long long )chunk);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	next = ts_ns(&start);
+	for (off = 0; off < st.st_size; off += n) {
+		n = (st.st_size - off < chunk) ? st.st_size - off : chunk;
+		if (baud > 0) {
+			next += n * 10 * NSEC / baud;
+			ts.tv_sec = next / NSEC;
+			ts.tv_nsec = next % NSEC;
+			clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		}
+		clock_gettime(CLOCK_REALTIME, &stamp.real);
+		clock_gettime(CLOCK_MONOTONIC, &stamp.mono);
+		gps_feed(&parser, data + off, n, &stamp);
+	}
+	/*
+	 * Say how long that all took.
+	 */
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	elapsed = ts_ns(&ts) - ts_ns(&start);
+	if (elapsed < 1)
+		elapsed = 1;
+	fprintf(stderr, "%lld bytes, %lu sentences, %lu fixes in %.3f seconds.\n",
+			(long long )st.st_size, parser.nsentences, nfixes, elapsed / 1e9);
+	fprintf(stderr, "%.0f sentences/sec, %.1f MB/sec, %.1f ns/byte.\n",
+			parser.nsentences * 1e9 / elapsed,
+			st.st_size * 1e3 / elapsed, (double )elapsed / st.st_size);
+	munmap(data, st.st_size);
+	close(fd);
+	exit(0);
+}
+
+/*
+ * We have a fix from the recorded data.
+ */
+void
+replay_fix(struct gps_parser *gp, struct gps_fix *fp)
+{
+	nfixes++;
+	set_clock(fp);
+}
@@ -0,0 +1,279 @@
+/*
+ * Copyright (c) 2022, Kalopa Robotics Limited.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of Kalopa Robotics nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL KALOPA ROBOTICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * ABSTRACT
+ * Scan an NMEA sentence for field delimiters and compute its checksum.
+ */
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+#if defined(__ARM_NEON)
+#define SCAN_NEON
+#include <arm_neon.h>
+#endif
+
+#include "libgpstime.h"
+
+static	void	scan_scalar(const char *, int, struct gps_scan *);
+#ifdef SCAN_X86
+static	void	scan_sse2(const char *, int, struct gps_scan *);
+static	void	scan_avx2(const char *, int, struct gps_scan *);
+#endif
+#ifdef SCAN_NEON
+static	void	scan_neon(const char *, int, struct gps_scan *);
+#endif
+
+/*
+ * The available scanning kernels, best first. The first one the CPU
+ * can run is the one we use.
+ */
+static	struct	kernel	{
+	char	*name;
+	void	(*func)(const char *, int, struct gps_scan *);
+} kernels[] = {
+#ifdef SCAN_X86
+	{"avx2", scan_avx2},
+	{"sse2", scan_sse2},
+#endif
+#ifdef SCAN_NEON
+	{"neon", scan_neon},
+#endif
+	{"scalar", scan_scalar},
+	{NULL, NULL}
+};
+
+static	struct kernel *kp = &kernels[sizeof(kernels) / sizeof(kernels[0]) - 2];
+
+/*
+ * Pick the best kernel when the library is loaded, rather than on the
+ * first scan, so that there's no race between threads to do it. Until
+ * then (or if nothing better turns up) it's the scalar one.
+ */
+__attribute__((constructor))
+static void
+scan_init()
+{
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+#endif
+	gps_scan_select(NULL);
+}
+
+/*
+ * Scan a sentence (without the leading '$'). Record the offset of
+ * each comma, and the asterisk which introduces the checksum, and
+ * compute the XOR checksum of everything before the asterisk.
+ */
+void
+gps_scan(const char *line, int len, struct gps_scan *sp)
+{
+	sp->csum = 0;
+	sp->star = -1;
+	sp->nfields = 1;
+	kp->func(line, len, sp);
+}
+
+/*
+ * Choose a scanning kernel, either by name or (if the name is NULL)
+ * the best one this CPU supports. Returns the name of the kernel, or
+ * NULL if the named one isn't available.
+ */
+char *
+gps_scan_select(const char *name)
+{
+	struct kernel *ckp;
+
+	for (ckp = kernels; ckp->name != NULL; ckp++) {
+		if (name != NULL && strcmp(name, ckp->name) != 0)
+			continue;
+#ifdef SCAN_X86
+		if (ckp->func == scan_avx2 && !__builtin_cpu_supports("avx2"))
+			continue;
+		if (ckp->func == scan_sse2 && !__builtin_cpu_supports("sse2"))
+			continue;
+#endif
+		return((kp = ckp)->name);
+	}
+	return(NULL);
+}
+
+/*
+ * Record the position of a comma.
+ */
+static inline void
+delim(struct gps_scan *sp, int offset)
+{
+	if (sp->nfields <= GPS_MAXFIELDS)
+		sp->delim[sp->nfields - 1] = offset;
+	sp->nfields++;
+}
+
+/*
+ * Record the commas flagged in a bitmask, for the block at offset.
+ */
+static inline void
+delimask(struct gps_scan *sp, int offset, unsigned int mask)
+{
+	while (mask != 0) {
+		delim(sp, offset + __builtin_ctz(mask));
+		mask &= mask - 1;
+	}
+}
+
+/*
+ * Scan a character at a time, starting at the given offset. This is
+ * the portable version, and it's also used by the vector versions to
+ * finish off whatever is left after the last full block.
+ */
+static void
+scan_tail(const char *line, int i, int len, struct gps_scan *sp)
+{
+	int csum = sp->csum;
+
+	for (; i < len; i++) {
+		if (line[i] == '*') {
+			sp->star = i;
+			break;
+		}
+		if (line[i] == ',')
+			delim(sp, i);
+		csum ^= line[i];
+	}
+	sp->csum = csum & 0xff;
+}
+
+static void
+scan_scalar(const char *line, int len, struct gps_scan *sp)
+{
+	scan_tail(line, 0, len, sp);
+}
+
+#ifdef SCAN_X86
+/*
+ * Fold a vector of XOR'd bytes down to a single byte.
+ */
+__attribute__((target("sse2")))
+static inline int
+xorfold128(__m128i acc)
+{
+	acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 8));
+	acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 4));
+	acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 2));
+	acc = _mm_xor_si128(acc, _mm_srli_si128(acc, 1));
+	return(_mm_cvtsi128_si32(acc) & 0xff);
+}
+
+/*
+ * SSE2 version - sixteen characters at a time. As soon as we see a
+ * block with the asterisk in it, let the scalar code finish up.
+ */
+__attribute__((target("sse2")))
+static void
+scan_sse2(const char *line, int len, struct gps_scan *sp)
+{
+	int i;
+	__m128i v, acc = _mm_setzero_si128();
+	__m128i comma = _mm_set1_epi8(','), star = _mm_set1_epi8('*');
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		v = _mm_loadu_si128((const __m128i *)(line + i));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, star)) != 0)
+			break;
+		delimask(sp, i, _mm_movemask_epi8(_mm_cmpeq_epi8(v, comma)));
+		acc = _mm_xor_si128(acc, v);
+	}
+	sp->csum = xorfold128(acc);
+	scan_tail(line, i, len, sp);
+}
+
+/*
+ * AVX2 version - thirty-two characters at a time.
+ */
+__attribute__((target("avx2")))
+static void
+scan_avx2(const char *line, int len, struct gps_scan *sp)
+{
+	int i;
+	__m256i v, acc = _mm256_setzero_si256();
+	__m256i comma = _mm256_set1_epi8(','), star = _mm256_set1_epi8('*');
+
+	for (i = 0; i + 32 <= len; i += 32) {
+		v = _mm256_loadu_si256((const __m256i *)(line + i));
+		if (_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, star)) != 0)
+			break;
+		delimask(sp, i, _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, comma)));
+		acc = _mm256_xor_si256(acc, v);
+	}
+	sp->csum = xorfold128(_mm_xor_si128(_mm256_castsi256_si128(acc),
+					_mm256_extracti128_si256(acc, 1)));
+	scan_tail(line, i, len, sp);
+}
+#endif
+
+#ifdef SCAN_NEON
+/*
+ * NEON version - sixteen characters at a time. There's no movemask,
+ * so narrow each comparison into a 64-bit mask with four bits per
+ * character.
+ */
+static void
+scan_neon(const char *line, int len, struct gps_scan *sp)
+{
+	int i, j;
+	uint64_t m;
+	uint8_t bytes[16];
+	uint8x16_t v, acc = vdupq_n_u8(0);
+	uint8x16_t comma = vdupq_n_u8(','), star = vdupq_n_u8('*');
+
+	for (i = 0; i + 16 <= len; i += 16) {
+		v = vld1q_u8((const uint8_t *)(line + i));
+		m = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(
+				vreinterpretq_u16_u8(vceqq_u8(v, star)), 4)), 0);
+		if (m != 0)
+			break;
+		m = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(
+				vreinterpretq_u16_u8(vceqq_u8(v, comma)), 4)), 0);
+		while (m != 0) {
+			delim(sp, i + (__builtin_ctzll(m) >> 2));
+			m &= ~(0xfULL << (__builtin_ctzll(m) & ~3));
+		}
+		acc = veorq_u8(acc, v);
+	}
+	vst1q_u8(bytes, acc);
+	for (j = 0; j < 16; j++)
+		sp->csum ^= bytes[j];
+	scan_tail(line, i, len, sp);
+}
+#endif
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2022, Kalopa Robotics Limited.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above
+ *    copyright notice, this list of conditions and the following
+ *    disclaimer in the documentation and/or other materials provided
+ *    with the distribution.
+ *
+ * 3. Neither the name of Kalopa Robotics nor the names of its
+ *    contributors may be used to endorse or promote products derived
+ *    from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY KALOPA ROBOTICS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT
+ * NOT LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT
+ * SHALL KALOPA ROBOTICS OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT,
+ * INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+ * OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT,
+ * STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF
+ * ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ *
+ * Decode the u-blox UBX binary messages which carry the time. Each
+ * message is two sync characters (0xB5 0x62), a class and an ID, a
+ * little-endian 16-bit payload length, the payload, and a two-byte
+ * Fletcher checksum over everything between the sync characters and
+ * the checksum. gps_feed() does the framing, and hands each complete
+ * message to gps_ubx_message().
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "libgpstime.h"
+
+#define UBX_NAV		0x01
+#define UBX_TIM		0x0d
+
+#define NAV_PVT		0x07
+#define NAV_TIMEUTC	0x21
+#define TIM_TP		0x01
+
+#define U1(p, o)	((p)[o])
+#define U2(p, o)	((p)[o] | (p)[(o) + 1] << 8)
+#define U4(p, o)	((uint32_t )U2(p, o) | (uint32_t )U2(p, (o) + 2) << 16)
+#define I4(p, o)	((int32_t )U4(p, o))
+
+static	void	nav_pvt(struct gps_parser *, const unsigned char *, int, int);
+static	void	nav_timeutc(struct gps_parser *, const unsigned char *, int, int);
+static	void	tim_tp(struct gps_parser *, const unsigned char *, int);
+static	int	ubx_time(struct gps_fix *, const unsigned char *, int32_t);
+
+/*
+ * Handle a complete UBX message, from the first sync character to the
+ * end of the checksum. The framer has already checked that the length
+ * adds up.
+ */
+void
+gps_ubx_message(struct gps_parser *gp, const char *buf, int len)
+{
+	int i, plen;
+	unsigned char cka = 0, ckb = 0;
+	const unsigned char *msg = (const unsigned char *)buf;
+
+	plen = U2(msg, 4);
+	if (gp->verbose)
+		printf("UBX: class 0x%02x id 0x%02x, %d bytes\n", msg[2], msg[3], plen);
+	for (i = 2; i < plen + 6; i++) {
+		cka += msg[i];
+		ckb += cka;
+	}
+	if (cka != msg[plen + 6] || ckb != msg[plen + 7]) {
+		if (gp->verbose)
+			printf("?Invalid UBX checksum - ignoring...\n");
+		return;
+	}
+	switch (msg[2] << 8 | msg[3]) {
+	case UBX_NAV << 8 | NAV_PVT:
+		nav_pvt(gp, msg + 6, plen, len);
+		break;
+
+	case UBX_NAV << 8 | NAV_TIMEUTC:
+		nav_timeutc(gp, msg + 6, plen, len);
+		break;
+
+	case UBX_TIM << 8 | TIM_TP:
+		tim_tp(gp, msg + 6, plen);
+		break;
+	}
+}
+
+/*
+ * NAV-PVT has the time and date (and a lot else besides), whether
+ * they're valid and fully resolved, and the number of satellites used.
+ */
+static void
+nav_pvt(struct gps_parser *gp, const unsigned char *pp, int plen, int len)
+{
+	struct gps_fix fix;
+
+	if (plen < 92) {
+		if (gp->verbose)
+			printf("?Short NAV-PVT message - ignoring...\n");
+		return;
+	}
+	if (ubx_time(&fix, pp + 4, I4(pp, 16)) < 0) {
+		if (gp->verbose)
+			printf("?Invalid time or date in NAV-PVT message - ignoring...\n");
+		return;
+	}
+	/*
+	 * Valid date, valid time and fully resolved.
+	 */
+	fix.valid = (U1(pp, 11) & 0x07) == 0x07;
+	gp->nsats = U1(pp, 23);
+	gps_timefix(gp, len, &fix);
+}
+
+/*
+ * NAV-TIMEUTC is just the time and date, and whether UTC is known.
+ */
+static void
+nav_timeutc(struct gps_parser *gp, const unsigned char *pp, int plen, int len)
+{
+	struct gps_fix fix;
+
+	if (plen < 20) {
+		if (gp->verbose)
+			printf("?Short NAV-TIMEUTC message - ignoring...\n");
+		return;
+	}
+	if (ubx_time(&fix, pp + 12, I4(pp, 8)) < 0) {
+		if (gp->verbose)
+			printf("?Invalid time or date in NAV-TIMEUTC message - ignoring...\n");
+		return;
+	}
+	fix.valid = (U1(pp, 19) & 0x04) != 0;
+	gps_timefix(gp, len, &fix);
+}
+
+/*
+ * TIM-TP is sent ahead of each time pulse, and says how far (in
+ * picoseconds) the pulse will be from the true top of the second,
+ * because the receiver can only generate it on an edge of its own
+ * clock. Hang on to it for the fix which goes with that pulse.
+ */
+static void
+tim_tp(struct gps_parser *gp, const unsigned char *pp, int plen)
+{
+	if (plen < 16)
+		return;
+	gp->qerr = I4(pp, 8);
+	if (gp->verbose)
+		printf("Next pulse quantisation error %ldps\n", gp->qerr);
+}
+
+/*
+ * Convert the year, month, day, hour, minute and second (seven bytes,
+ * which both NAV messages have in the same layout) to a time. The
+ * nanoseconds are the receiver's idea of how far the navigation epoch
+ * is from that second, and are tiny compared to anything the serial
+ * timestamps can resolve, so the time is rounded to the millisecond.
+ */
+static int
+ubx_time(struct gps_fix *fp, const unsigned char *tp, int32_t nano)
+{
+	int64_t ns;
+	int year = U2(tp, 0), mon = U1(tp, 2), mday = U1(tp, 3);
+	int hour = U1(tp, 4), min = U1(tp, 5), sec = U1(tp, 6);
+
+	if (year < 1980 || mon < 1 || mon > 12 || mday < 1 || mday > 31 ||
+				hour > 23 || min > 59 || sec > 60)
+		return(-1);
+	if (nano < -1000000000 || nano > 1000000000)
+		return(-1);
+	ns = (int64_t )gps_utctime(year, mon, mday, hour, min, sec) * 1000000000LL;
+	ns += nano + 500000;
+	ns -= ns % 1000000;
+	fp->utc.tv_sec = ns / 1000000000;
+	fp->utc.tv_nsec = ns % 1000000000;
+	return(0);
+}